@@ -41,6 +41,9 @@
 AutoComplete::AutoComplete(Configuration *configuration)
 {
   m_configuration = configuration;
+  #ifdef HAVE_OMP_HEADER
+  omp_init_lock(&m_similarCommandsLock);
+  #endif
 }
 
 void AutoComplete::ClearWorksheetWords()
@@ -138,7 +141,7 @@ void AutoComplete::AddWorksheetWords(wxArrayString wordlist)
   {
     wxArrayString::const_iterator it;
     for (it = wordlist.begin(); it != wordlist.end(); ++it)
-      m_worksheetWords[*it] = 1;
+      m_worksheetWords.insert(*it);
   }
 }
 
@@ -147,6 +150,9 @@ AutoComplete::~AutoComplete()
   #ifdef HAVE_OPENMP_TASKS
   #pragma omp taskwait
   #endif
+  #ifdef HAVE_OMP_HEADER
+  omp_destroy_lock(&m_similarCommandsLock);
+  #endif
 }
 
 void AutoComplete::LoadSymbols()
@@ -173,17 +179,16 @@ void AutoComplete::BuiltinSymbols_BackgroundTask()
     m_wordList[tmplte].Clear();
     m_wordList[esccommand].Clear();
     m_wordList[unit].Clear();
+    m_symbols[command].clear();
+    m_symbols[tmplte].clear();
+    m_symbols[esccommand].clear();
+    m_symbols[unit].clear();
   
     LoadBuiltinSymbols();
     
     for (auto it = Configuration::EscCodesBegin(); it != Configuration::EscCodesEnd(); ++it)
        m_wordList[esccommand].Add(it->first);
 
-    m_wordList[command].Sort();
-    m_wordList[tmplte].Sort();
-    m_wordList[unit].Sort();
-    m_wordList[esccommand].Sort();
-
     wxString line;
 
     /// Load private symbol list (do something different on Windows).
@@ -244,6 +249,28 @@ void AutoComplete::BuiltinSymbols_BackgroundTask()
         text.Flush();
       }
     }
+
+    // Move the symbols into the indexes the autocompletion searches
+    autoCompletionType symbolTypes[] = {command, tmplte, esccommand, unit};
+    for (auto type : symbolTypes)
+    {
+      for (auto const &symbol : m_wordList[type])
+        m_symbols[type].insert(symbol);
+      m_wordList[type].Clear();
+      m_wordList[type].Shrink();
+    }
+    // Build the index of the command names before FindSimilarSymbols() is
+    // blocked from using the old one
+    FuzzyWordIndex similarCommands;
+    for (auto const &symbol : m_symbols[command])
+      similarCommands.Add(symbol);
+    #ifdef HAVE_OMP_HEADER
+    omp_set_lock(&m_similarCommandsLock);
+    #endif
+    m_similarCommands = std::move(similarCommands);
+    #ifdef HAVE_OMP_HEADER
+    omp_unset_lock(&m_similarCommandsLock);
+    #endif
   }
 }
 
@@ -255,6 +282,13 @@ void AutoComplete::LoadSymbols_BackgroundTask()
   {
     // Error dialogues need to be created by the foreground thread.
     SuppressErrorDialogs suppressor;
+
+    // Only the directories that have changed since the last session need to be read
+    if(!m_directoriesLoaded)
+    {
+      m_directories.Load(Dirstructure::Get()->DirectoryIndexFile());
+      m_directoriesLoaded = true;
+    }
     
     // Prepare a list of all built-in loadable files of maxima.
     {
@@ -272,20 +306,16 @@ void AutoComplete::LoadSymbols_BackgroundTask()
           wxString::Format(
             _("Autocompletion: Scanning %s recursively for loadable lisp files."),
             shareDir.GetFullPath().utf8_str()));
-        wxDir maximadir(shareDir.GetFullPath());
-        if(maximadir.IsOpened())
-          maximadir.Traverse(maximaLispIterator); //todo
+        m_directories.Traverse(shareDir.GetFullPath(), maximaLispIterator);
       }
       GetMacFiles userLispIterator (m_builtInLoadFiles);
       wxFileName userDir(Dirstructure::Get()->UserConfDir() + "/");
       userDir.MakeAbsolute();
-      wxDir maximauserfilesdir(userDir.GetFullPath());
       wxLogMessage(
         wxString::Format(
           _("Autocompletion: Scanning %s for loadable lisp files."),
           userDir.GetFullPath().utf8_str()));
-      if(maximauserfilesdir.IsOpened())
-        maximauserfilesdir.Traverse(userLispIterator);
+      m_directories.Traverse(userDir.GetFullPath(), userLispIterator);
       int num = m_builtInLoadFiles.GetCount();
       wxLogMessage(
         wxString::Format(
@@ -307,9 +337,7 @@ void AutoComplete::LoadSymbols_BackgroundTask()
           _("Autocompletion: Scanning %s for loadable demo files."),
           demoDir.GetFullPath().utf8_str()));
 
-      wxDir maximadir(demoDir.GetFullPath());
-      if(maximadir.IsOpened())
-        maximadir.Traverse(maximaLispIterator);
+      m_directories.Traverse(demoDir.GetFullPath(), maximaLispIterator);
       int num = m_builtInDemoFiles.GetCount();
       wxLogMessage(
         wxString::Format(
@@ -320,6 +348,7 @@ void AutoComplete::LoadSymbols_BackgroundTask()
     }
     m_builtInLoadFiles.Sort();
     m_builtInDemoFiles.Sort();
+    m_directories.Save(Dirstructure::Get()->DirectoryIndexFile());
   }
 }
 
@@ -359,9 +388,7 @@ void AutoComplete::UpdateDemoFiles(wxString partial, wxString maximaDir)
     if(partial != wxT("//"))
     {
       GetDemoFiles userLispIterator(m_wordList[demofile], prefix);
-      wxDir demofilesdir(partial);
-      if(demofilesdir.IsOpened())
-        demofilesdir.Traverse(userLispIterator);
+      m_directories.Traverse(partial, userLispIterator);
     }
   }
 }
@@ -399,9 +426,7 @@ void AutoComplete::UpdateGeneralFiles(wxString partial, wxString maximaDir)
     if(partial != wxT("//"))
     {
       GetGeneralFiles fileIterator(m_wordList[generalfile], prefix);
-      wxDir generalfilesdir(partial);
-      if(generalfilesdir.IsOpened())
-        generalfilesdir.Traverse(fileIterator);
+      m_directories.Traverse(partial, fileIterator);
     }
   }
 }
@@ -443,13 +468,18 @@ void AutoComplete::UpdateLoadFiles(wxString partial, wxString maximaDir)
     if(partial != wxT("//"))
     {
       GetMacFiles userLispIterator(m_wordList[loadfile], prefix);
-      wxDir loadfilesdir(partial);
-      if(loadfilesdir.IsOpened())
-        loadfilesdir.Traverse(userLispIterator);
+      m_directories.Traverse(partial, userLispIterator);
     }
   }
 }
 
+void AutoComplete::Complete(const WordIndex &index, const wxString &prefix, wxArrayString &result)
+{
+  for (WordIndex::const_iterator it = index.lower_bound(prefix);
+       (it != index.end()) && it->StartsWith(prefix); ++it)
+    result.Add(*it);
+}
+
 /// Returns a string array with functions which start with partial.
 wxArrayString AutoComplete::CompleteSymbol(wxString partial, autoCompletionType type)
 {
@@ -469,55 +499,78 @@ wxArrayString AutoComplete::CompleteSymbol(wxString partial, autoCompletionType
   
     wxASSERT_MSG((type >= command) && (type <= unit), _("Bug: Autocompletion requested for unknown type of item."));
   
-    if (type != tmplte)
+    if ((type == loadfile) || (type == demofile) || (type == generalfile))
     {
+      // The lists of files are assembled anew for every directory and therefore
+      // aren't indexed.
       for (size_t i = 0; i < m_wordList[type].GetCount(); i++)
       {
-        if (m_wordList[type][i].StartsWith(partial) &&
-            completions.Index(m_wordList[type][i]) == wxNOT_FOUND)
+        if (m_wordList[type][i].StartsWith(partial))
           completions.Add(m_wordList[type][i]);
       }
+      completions.Sort();
+      for (size_t i = 1; i < completions.GetCount();)
+      {
+        if (completions[i] == completions[i - 1])
+          completions.RemoveAt(i);
+        else
+          i++;
+      }
     }
     else
     {
-      for (size_t i = 0; i < m_wordList[type].GetCount(); i++)
+      Complete(m_symbols[type], partial, completions);
+
+      if (type == tmplte)
       {
-        wxString templ = m_wordList[type][i];
-        if (templ.StartsWith(partial))
+        for (size_t i = 0; i < completions.GetCount(); i++)
         {
-          if (completions.Index(templ) == wxNOT_FOUND)
-            completions.Add(templ);
-          if (templ.SubString(0, templ.Find(wxT("(")) - 1) == partial &&
-              perfectCompletions.Index(templ) == wxNOT_FOUND)
+          const wxString &templ = completions[i];
+          if (templ.SubString(0, templ.Find(wxT("(")) - 1) == partial)
             perfectCompletions.Add(templ);
         }
       }
-    }
 
-    // Add a list of words that were definied on the work sheet but that aren't
-    // defined as maxima commands or functions.
-    if (type == command)
-    {
-      WorksheetWords::const_iterator it;
-      for (it = m_worksheetWords.begin(); it != m_worksheetWords.end(); ++it)
+      // Add a list of words that were definied on the work sheet but that aren't
+      // defined as maxima commands or functions.
+      if (type == command)
       {
-        if (it->first.StartsWith(partial))
+        for (WordIndex::const_iterator it = m_worksheetWords.lower_bound(partial);
+             (it != m_worksheetWords.end()) && it->StartsWith(partial); ++it)
         {
-          if (completions.Index(it->first) == wxNOT_FOUND)
-          {
-            completions.Add(it->first);
-          }
+          if (m_symbols[command].find(*it) == m_symbols[command].end())
+            completions.Add(*it);
         }
+        completions.Sort();
       }
     }
-
-    completions.Sort();
   }
   if (perfectCompletions.Count() > 0)
     return perfectCompletions;
   return completions;
 }
 
+void AutoComplete::FindSimilarSymbols(const wxString &word, int maxDistance,
+                                      std::vector<wxArrayString> &result)
+{
+  result.clear();
+  if(maxDistance > 0)
+    result.resize(maxDistance);
+  #ifdef HAVE_OMP_HEADER
+  // This function is called from the GUI thread that shouldn't wait until a
+  // background task has finished loading the symbols.
+  if(!omp_test_lock(&m_similarCommandsLock))
+    return;
+  m_similarCommands.FindSimilar(word, maxDistance, result);
+  omp_unset_lock(&m_similarCommandsLock);
+  #else
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (AutocompleteBuiltins)
+  #endif
+  m_similarCommands.FindSimilar(word, maxDistance, result);
+  #endif
+}
+
 void AutoComplete::AddSymbol(wxString fun, autoCompletionType type)
 {
   #ifdef HAVE_OPENMP_TASKS
@@ -546,8 +599,18 @@ void AutoComplete::AddSymbol_nowait(wxString fun, autoCompletionType type)
   }
 
   /// Add symbols
-  if ((type != tmplte) && m_wordList[type].Index(fun, true, true) == wxNOT_FOUND)
-    m_wordList[type].Add(fun);
+  if (type != tmplte)
+    m_symbols[type].insert(fun);
+  if (type == command)
+  {
+    #ifdef HAVE_OMP_HEADER
+    omp_set_lock(&m_similarCommandsLock);
+    #endif
+    m_similarCommands.Add(fun);
+    #ifdef HAVE_OMP_HEADER
+    omp_unset_lock(&m_similarCommandsLock);
+    #endif
+  }
 
   /// Add templates - for given function and given argument count we
   /// only add one template. We count the arguments by counting '<'
@@ -556,15 +619,15 @@ void AutoComplete::AddSymbol_nowait(wxString fun, autoCompletionType type)
     fun = FixTemplate(fun);
     wxString funName = fun.SubString(0, fun.Find(wxT("(")));
     long count = fun.Freq('<');
-    size_t i = 0;
-    for (i = 0; i < m_wordList[type].GetCount(); i++)
+    WordIndex::const_iterator it;
+    for (it = m_symbols[type].lower_bound(funName);
+         (it != m_symbols[type].end()) && it->StartsWith(funName); ++it)
     {
-      wxString t = m_wordList[type][i];
-      if (t.StartsWith(funName) && (t.Freq('<') == count))
+      if (it->Freq('<') == count)
         break;
     }
-    if (i == m_wordList[type].GetCount())
-      m_wordList[type].Add(fun);
+    if ((it == m_symbols[type].end()) || !it->StartsWith(funName))
+      m_symbols[type].insert(fun);
   }
 }
 
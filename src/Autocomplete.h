@@ -30,12 +30,20 @@
 #ifndef AUTOCOMPLETE_H
 #define AUTOCOMPLETE_H
 
+#include "Version.h"
 #include <wx/wx.h>
 #include <wx/dir.h>
 #include <wx/arrstr.h>
 #include <wx/regex.h>
 #include <wx/filename.h>
 #include "Configuration.h"
+#include "FuzzyWordIndex.h"
+#include "DirectoryIndex.h"
+#include <set>
+
+#ifdef HAVE_OMP_HEADER
+#include <omp.h>
+#endif
 
 /* The autocompletion logic
 
@@ -48,7 +56,12 @@
  */
 class AutoComplete
 {
-  WX_DECLARE_STRING_HASH_MAP(int, WorksheetWords);
+  /*! A sorted list of words without duplicates
+
+    All words that start with the same prefix are stored next to each other
+    which means that they can be found by a binary search for the prefix.
+  */
+  typedef std::set<wxString> WordIndex;
 
 public:
   //! All types of things we can autocomplete
@@ -102,6 +115,13 @@ public:
   
   //! Returns a list of possible autocompletions for the string "partial"
   wxArrayString CompleteSymbol(wxString partial, autoCompletionType type = command);
+  /*! Finds the command names that differ from word by 1 to maxDistance edits
+
+    See FuzzyWordIndex::FindSimilar() for the format of result. Doesn't wait
+    for a background task that currently updates the list of commands:
+    In this case no command is returned.
+  */
+  void FindSimilarSymbols(const wxString &word, int maxDistance, std::vector<wxArrayString> &result);
   //! Basically runs a regex over templates
   static wxString FixTemplate(wxString templ);
 
@@ -121,6 +141,10 @@ private:
   wxArrayString m_builtInLoadFiles;
   //! The list of demo files maxima provides
   wxArrayString m_builtInDemoFiles;
+  //! The contents of the directories we scan for files
+  DirectoryIndex m_directories;
+  //! Has m_directories been read from its file already?
+  bool m_directoriesLoaded = false;
 
   //! Scans the maxima directory for a list of loadable files
   class GetGeneralFiles : public wxDirTraverser
@@ -262,10 +286,26 @@ private:
       }
   };
 
-  //! The lists of autocompletible symbols for the classes defined in autoCompletionType
+  //! Appends all words from index that start with prefix to result
+  static void Complete(const WordIndex &index, const wxString &prefix, wxArrayString &result);
+
+  /*! The lists of autocompletible symbols for the classes defined in autoCompletionType
+
+    For the file types these are the lists that are searched. For all other types
+    it only holds the builtin symbols until they have been added to m_symbols.
+  */
   wxArrayString m_wordList[7];
+  //! The autocompletible symbols of all types except for the file types
+  WordIndex m_symbols[7];
+  //! The command names, indexed by their spelling
+  FuzzyWordIndex m_similarCommands;
+  #ifdef HAVE_OMP_HEADER
+  //! Guards m_similarCommands so FindSimilarSymbols() can test if it is in use
+  omp_lock_t m_similarCommandsLock;
+  #endif
   static wxRegEx m_args;
-  WorksheetWords m_worksheetWords;
+  //! The words that appear in the worksheet
+  WordIndex m_worksheetWords;
 };
 
 #endif // AUTOCOMPLETE_H
@@ -0,0 +1,223 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file defines the class BitmapCache that holds the scaled versions of
+  the images in the worksheet.
+ */
+
+#include "BitmapCache.h"
+#include "Version.h"
+#include <iterator>
+
+bool BitmapCache::Lookup(const Image *image, wxSize size, wxBitmap &bitmap)
+{
+  bool found = false;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    auto index = m_index.find(image);
+    if ((index != m_index.end()) && (index->second->m_size == size))
+    {
+      Entry &entry = *index->second;
+      // Convert the result of a prefetch to the bitmap it is needed as
+      if (!entry.HasBitmap() && entry.m_scaled.IsOk())
+      {
+        entry.m_bitmap = wxBitmap(entry.m_scaled);
+        entry.m_scaled.Destroy();
+        UpdateBytes(entry);
+      }
+      if (entry.HasBitmap())
+      {
+        found = true;
+        bitmap = entry.m_bitmap;
+        // Mark the entry as the one that has been used most recently
+        m_entries.splice(m_entries.begin(), m_entries, index->second);
+        Shrink();
+      }
+    }
+    if (found)
+      m_hits++;
+    else
+      m_misses++;
+  }
+  return found;
+}
+
+void BitmapCache::Add(const Image *image, const wxBitmap &bitmap)
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    Entry &entry = Insert(image, bitmap.GetSize());
+    entry.m_bitmap = bitmap;
+    UpdateBytes(entry);
+    Shrink();
+  }
+}
+
+bool BitmapCache::StartPrefetch(const Image *image, wxSize size)
+{
+  bool start = false;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    auto index = m_index.find(image);
+    if (index == m_index.end())
+    {
+      // An entry with neither a bitmap nor an image tells that the prefetch is
+      // in progress.
+      Insert(image, size);
+      start = true;
+    }
+    else if (index->second->m_size != size)
+    {
+      // The bitmap of the old size is kept as a placeholder.
+      Entry &entry = *index->second;
+      entry.m_size = size;
+      entry.m_scaled.Destroy();
+      entry.m_failed = false;
+      UpdateBytes(entry);
+      start = true;
+    }
+  }
+  return start;
+}
+
+bool BitmapCache::IsBeingPrefetched(const Image *image, wxSize size, wxBitmap &placeholder)
+{
+  bool pending = false;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    auto index = m_index.find(image);
+    if ((index != m_index.end()) && (index->second->m_size == size) &&
+        index->second->IsPending())
+    {
+      pending = true;
+      placeholder = index->second->m_bitmap;
+    }
+  }
+  return pending;
+}
+
+void BitmapCache::AddPrefetched(const Image *image, wxSize size, wxImage &scaled)
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    auto index = m_index.find(image);
+    if ((index != m_index.end()) && (index->second->m_size == size) &&
+        index->second->IsPending())
+    {
+      Entry &entry = *index->second;
+      if (scaled.IsOk())
+        entry.m_scaled = scaled;
+      else
+        entry.m_failed = true;
+      UpdateBytes(entry);
+    }
+    scaled.Destroy();
+    m_prefetchesDone++;
+  }
+}
+
+void BitmapCache::Remove(const Image *image)
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    auto index = m_index.find(image);
+    if (index != m_index.end())
+      Erase(index->second);
+  }
+}
+
+void BitmapCache::SetMaxBytes(size_t bytes)
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    m_maxBytes = bytes;
+    Shrink();
+  }
+}
+
+void BitmapCache::Clear()
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (BitmapCache)
+  #endif
+  {
+    m_index.clear();
+    m_entries.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+  }
+}
+
+void BitmapCache::Erase(EntryList::iterator entry)
+{
+  m_bytes -= entry->m_bytes;
+  m_index.erase(entry->m_image);
+  m_entries.erase(entry);
+}
+
+BitmapCache::Entry &BitmapCache::Insert(const Image *image, wxSize size)
+{
+  auto index = m_index.find(image);
+  if (index != m_index.end())
+    Erase(index->second);
+  m_entries.emplace_front();
+  Entry &entry = m_entries.front();
+  entry.m_image = image;
+  entry.m_size = size;
+  m_index[image] = m_entries.begin();
+  return entry;
+}
+
+void BitmapCache::UpdateBytes(Entry &entry)
+{
+  m_bytes -= entry.m_bytes;
+  entry.m_bytes = 0;
+  if (entry.m_bitmap.IsOk())
+    entry.m_bytes += size_t(entry.m_bitmap.GetWidth()) * entry.m_bitmap.GetHeight() * 4;
+  if (entry.m_scaled.IsOk())
+    entry.m_bytes += size_t(entry.m_scaled.GetWidth()) * entry.m_scaled.GetHeight() * 4;
+  m_bytes += entry.m_bytes;
+}
+
+void BitmapCache::Shrink()
+{
+  // The entry that has been used last is kept even if it alone exceeds the
+  // budget: It is the one that is about to be drawn.
+  while ((m_bytes > m_maxBytes) && (m_entries.size() > 1))
+    Erase(std::prev(m_entries.end()));
+}
@@ -0,0 +1,161 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file declares the class BitmapCache that holds the scaled versions of
+  the images in the worksheet.
+ */
+
+#ifndef BITMAPCACHE_H
+#define BITMAPCACHE_H
+
+#include <wx/bitmap.h>
+#include <wx/image.h>
+#include <list>
+#include <unordered_map>
+
+class Image;
+
+/*! A process-wide cache for the scaled bitmaps the images are displayed as
+
+  Decoding a png or rasterizing a svg image and scaling it to the size it is
+  displayed in is slow. But the scaled bitmaps need a lot of memory. Instead of
+  letting every image keep its scaled bitmap (or drop it as soon as it is
+  scrolled out of view) all scaled bitmaps are held in this cache that drops the
+  bitmap that has been used least recently as soon as the bitmaps need more
+  memory than the user allows for.
+
+  An image is displayed in one size at a time: For each image the cache holds
+  only the bitmap for the size that has been requested last.
+
+  Images that are about to be scrolled into view can be decoded in a background
+  task (see Image::PrefetchBitmap()): Creating a wxBitmap isn't thread-safe, so
+  the task only creates a wxImage that is converted to a bitmap the first time
+  it is needed. Until then the bitmap of the size the image was displayed in
+  before is kept as a placeholder. As the reference counting of wxWidgets'
+  objects isn't thread-safe, either, background tasks never create, copy or
+  destroy a wxBitmap in here: Only functions called from the GUI thread do
+  that, including dropping entries that exceed the memory budget.
+*/
+class BitmapCache final
+{
+  BitmapCache(const BitmapCache &) = delete;
+  BitmapCache &operator=(const BitmapCache &) = delete;
+public:
+  BitmapCache() {}
+  static BitmapCache &Get()
+  {
+    static BitmapCache globalCache;
+    return globalCache;
+  }
+
+  /*! Looks up the bitmap for image in the given size
+
+    Must be called from the GUI thread.
+    \return true, if the bitmap was found.
+   */
+  bool Lookup(const Image *image, wxSize size, wxBitmap &bitmap);
+  //! Remembers the bitmap an image is displayed as in the bitmap's size
+  void Add(const Image *image, const wxBitmap &bitmap);
+  /*! Tells the cache that a background task will decode image in the given size
+
+    \return false, if the bitmap is already cached or being decoded.
+   */
+  bool StartPrefetch(const Image *image, wxSize size);
+  /*! Is a prefetch of image in the given size still running?
+
+    \param placeholder Is set to the bitmap the image has been displayed as
+    before, if there is such a bitmap.
+    
+    \return false, if the prefetch has finished or has failed.
+   */
+  bool IsBeingPrefetched(const Image *image, wxSize size, wxBitmap &placeholder);
+  /*! Stores the result of a prefetch started by StartPrefetch()
+
+    Can be called from a background task. scaled is reset while the lock is
+    held, so the task doesn't touch the image's reference count afterwards.
+    The result is dropped if the image has been removed from the cache in the
+    meantime, for example since it has been assigned new contents.
+   */
+  void AddPrefetched(const Image *image, wxSize size, wxImage &scaled);
+  //! The number of prefetches that have finished so far
+  unsigned long GetPrefetchesDone() const { return m_prefetchesDone; }
+  //! Forgets the bitmap for image
+  void Remove(const Image *image);
+  //! Sets the number of bytes the cached bitmaps may need
+  void SetMaxBytes(size_t bytes);
+  size_t GetBytes() const { return m_bytes; }
+  int GetHits() const { return m_hits; }
+  int GetMisses() const { return m_misses; }
+  void Clear();
+
+private:
+  struct Entry
+  {
+    //! The image this entry caches a bitmap for
+    const Image *m_image;
+    //! The size the image is scaled to
+    wxSize m_size;
+    /*! The scaled bitmap, if it has already been created
+
+      While a prefetch is running this is the bitmap of the old size.
+     */
+    wxBitmap m_bitmap;
+    //! The scaled image a prefetch has created, if it isn't a bitmap, yet.
+    wxImage m_scaled;
+    //! Has the prefetch for m_size failed?
+    bool m_failed = false;
+    //! The memory the entry needs
+    size_t m_bytes = 0;
+    //! Does m_bitmap have the size the image is displayed in?
+    bool HasBitmap() const { return m_bitmap.IsOk() && (m_bitmap.GetSize() == m_size); }
+    //! Is a prefetch for m_size running?
+    bool IsPending() const { return !HasBitmap() && !m_scaled.IsOk() && !m_failed; }
+  };
+  typedef std::list<Entry> EntryList;
+
+  //! Erases an entry. The caller must hold the lock.
+  void Erase(EntryList::iterator entry);
+  //! Inserts a new entry for image. The caller must hold the lock.
+  Entry &Insert(const Image *image, wxSize size);
+  //! Recalculates the memory an entry needs. The caller must hold the lock.
+  void UpdateBytes(Entry &entry);
+  /*! Drops the least recently used entries until we are within budget
+
+    Destroys bitmaps and therefore must only be called from the GUI thread.
+   */
+  void Shrink();
+
+  //! The entries, the entry that has been used most recently first
+  EntryList m_entries;
+  //! Where in m_entries the entry for each image is stored
+  std::unordered_map<const Image *, EntryList::iterator> m_index;
+  //! The memory all entries need together
+  size_t m_bytes = 0;
+  //! The memory the entries may need
+  size_t m_maxBytes = 200 * 1000 * 1000;
+  int m_hits = 0;
+  int m_misses = 0;
+  unsigned long m_prefetchesDone = 0;
+};
+
+#endif // BITMAPCACHE_H
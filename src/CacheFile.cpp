@@ -0,0 +1,90 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+
+  This file defines the classes CacheFileReader and CacheFileWriter that read
+  and write the files wxMaxima caches data in between sessions.
+ */
+
+#include "CacheFile.h"
+#include <wx/file.h>
+
+//! The string that marks the end of a complete cache file
+#define CACHEFILE_ENDMARKER wxT("end")
+
+CacheFileReader::CacheFileReader(const wxString &file, const wxString &magic, wxUint32 version) :
+  m_buffer(ReadFile(file)),
+  m_input(m_buffer.GetData(), m_buffer.GetDataLen()),
+  m_data(m_input),
+  m_ok(false)
+{
+  if(m_buffer.GetDataLen() == 0)
+    return;
+  if(m_data.ReadString() != magic)
+    return;
+  if(m_data.Read32() != version)
+    return;
+  m_ok = true;
+}
+
+wxMemoryBuffer CacheFileReader::ReadFile(const wxString &file)
+{
+  wxMemoryBuffer buffer;
+  if(!wxFileExists(file))
+    return buffer;
+  wxFile input(file);
+  if(!input.IsOpened())
+    return buffer;
+  wxFileOffset length = input.Length();
+  if(length <= 0)
+    return buffer;
+  if(input.Read(buffer.GetWriteBuf(length), length) != (ssize_t)length)
+    return wxMemoryBuffer();
+  buffer.UngetWriteBuf(length);
+  return buffer;
+}
+
+bool CacheFileReader::End()
+{
+  return IsOk() && (m_data.ReadString() == CACHEFILE_ENDMARKER);
+}
+
+CacheFileWriter::CacheFileWriter(const wxString &file, const wxString &magic, wxUint32 version) :
+  m_output(file),
+  m_data(m_output)
+{
+  if(!m_output.IsOk())
+    return;
+  m_data.WriteString(magic);
+  m_data.Write32(version);
+}
+
+bool CacheFileWriter::Commit()
+{
+  if(m_output.IsOk())
+    m_data.WriteString(CACHEFILE_ENDMARKER);
+  if(m_output.IsOk() && m_output.Commit())
+    return true;
+  m_output.Discard();
+  return false;
+}
@@ -0,0 +1,101 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+
+  This file declares the classes CacheFileReader and CacheFileWriter that read
+  and write the files wxMaxima caches data in between sessions.
+ */
+
+#ifndef CACHEFILE_H
+#define CACHEFILE_H
+
+#include <wx/string.h>
+#include <wx/buffer.h>
+#include <wx/mstream.h>
+#include <wx/wfstream.h>
+#include <wx/datstrm.h>
+
+/*! Reads a cache file that has been written by CacheFileWriter
+
+  The file is read into memory as a whole, which is much faster than reading
+  it string by string from disk. A file that has been written by a different
+  version of wxMaxima or for a different purpose is recognized by its header,
+  and a file that has been cut short by the lack of the end marker.
+
+  Usage: If IsOk() is true after the constructor has run the contents can be
+  read from Data(). The data is only to be used if End() returns true.
+*/
+class CacheFileReader
+{
+public:
+  /*! Reads the file and its header
+
+    \param file The name of the file
+    \param magic The string that tells what kind of data the file contains
+    \param version The version of the format of the data
+   */
+  CacheFileReader(const wxString &file, const wxString &magic, wxUint32 version);
+  //! Did the file exist and have the right header and could all data be read so far?
+  bool IsOk() const { return m_ok && m_input.IsOk(); }
+  //! The stream the contents of the file is read from
+  wxDataInputStream &Data() { return m_data; }
+  //! Reads the end marker. Returns false if the file isn't ok or has been cut short.
+  bool End();
+
+private:
+  //! Reads the whole of file into a buffer
+  static wxMemoryBuffer ReadFile(const wxString &file);
+  wxMemoryBuffer m_buffer;
+  wxMemoryInputStream m_input;
+  wxDataInputStream m_data;
+  bool m_ok;
+};
+
+/*! Writes a cache file that can be read by CacheFileReader
+
+  The data is written to a temporary file that only replaces the old file
+  once it is complete: Two wxMaxima processes that write the same cache at
+  the same time or a wxMaxima that crashes while writing it leave either the
+  old or a new file, but never a damaged one.
+*/
+class CacheFileWriter
+{
+public:
+  //! Starts writing file. The parameters are those of CacheFileReader().
+  CacheFileWriter(const wxString &file, const wxString &magic, wxUint32 version);
+  //! Could the file be created and everything be written to it so far?
+  bool IsOk() const { return m_output.IsOk(); }
+  //! The stream the contents of the file is written to
+  wxDataOutputStream &Data() { return m_data; }
+  /*! Writes the end marker and replaces the old file by the new one
+
+    \return false, if the file couldn't be written.
+  */
+  bool Commit();
+
+private:
+  wxTempFileOutputStream m_output;
+  wxDataOutputStream m_data;
+};
+
+#endif // CACHEFILE_H
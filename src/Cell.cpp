@@ -27,6 +27,7 @@
 */
 
 #include "Cell.h"
+#include "Image.h"
 #include <wx/regex.h>
 #include <wx/sstream.h>
 
@@ -41,7 +42,7 @@ wxString Cell::GetToolTip(const wxPoint &point)
       if (!(toolTip = tmp->GetToolTip(point)).IsEmpty())
         return toolTip;
 
-  return m_toolTip;
+  return GetLocalToolTip();
 }
 
 Cell::Cell(Cell *group, Configuration **config, CellPointers *cellPointers)
@@ -81,7 +82,7 @@ Cell::Cell(Cell *group, Configuration **config, CellPointers *cellPointers)
   m_SuppressMultiplicationDot = false;
   m_imageBorderWidth = 0;
   SetCurrentPoint(wxPoint(-1, -1));
-  m_toolTip = (*m_configuration)->GetDefaultCellToolTip();
+  SetToolTip((*m_configuration)->GetDefaultCellToolTip());
   m_fontSize = (*m_configuration)->GetMathFontSize();
 }
 
@@ -159,8 +160,10 @@ void Cell::SetType(CellType type)
 
 void Cell::CopyCommonData(const Cell & cell)
 {
-  m_altCopyText = cell.m_altCopyText;
-  m_toolTip = cell.m_toolTip;
+  if (cell.m_rareData)
+    m_rareData.reset(new RareData(*cell.m_rareData));
+  else
+    m_rareData.reset();
   m_forceBreakLine = cell.m_forceBreakLine;
   m_type = cell.m_type;
   m_textStyle = cell.m_textStyle;
@@ -170,17 +173,10 @@ void Cell::CopyCommonData(const Cell & cell)
 
 Cell *Cell::CopyList()
 {
-  Cell *dest = Copy();
-  Cell *ret = dest;
-  Cell *src = m_next;
-
-  while (src != NULL)
-  {
-    dest->AppendCell(src->Copy());
-    src = src->m_next;
-    dest = dest->m_next;
-  }
-  return ret;
+  CellListBuilder copy;
+  for (Cell *src = this; src != NULL; src = src->m_next)
+    copy.Append(src->Copy());
+  return copy.GetHead();
 }
 
 void Cell::ClearCacheList()
@@ -189,6 +185,12 @@ void Cell::ClearCacheList()
     tmp->ClearCache();
 }
 
+void Cell::PrefetchImageList()
+{
+  for(Cell *tmp = this; tmp != NULL; tmp = tmp->m_next)
+    tmp->PrefetchImage();
+}
+
 void Cell::SetGroupList(Cell *group)
 {
   for(Cell *tmp = this; tmp != NULL; tmp = tmp->m_next)
@@ -273,6 +275,30 @@ void Cell::AppendCell(Cell *p_next)
   LastToDraw->SetNextToDraw(p_next);
 }
 
+CellListBuilder::CellListBuilder(Cell *head) :
+  m_head(head),
+  m_tail(head)
+{
+  if (m_tail != NULL)
+    while (m_tail->m_next != NULL)
+      m_tail = m_tail->m_next;
+}
+
+void CellListBuilder::Append(Cell *cell)
+{
+  if (cell == NULL)
+    return;
+  if (m_head == NULL)
+    m_head = cell;
+  else
+    // m_tail is the last cell of the list => AppendCell() doesn't need to search
+    // for the end of the list.
+    m_tail->AppendCell(cell);
+  m_tail = cell;
+  while (m_tail->m_next != NULL)
+    m_tail = m_tail->m_next;
+}
+
 Cell *Cell::GetGroup()
 {
   wxASSERT_MSG(m_group != NULL, _("Bug: Math Cell that claims to have no group Cell it belongs to"));
@@ -401,7 +427,7 @@ void Cell::Draw(wxPoint point)
     SetCurrentPoint(point);
 
   // Mark all cells that contain tooltips
-  if(!m_toolTip.IsEmpty() && (GetStyle() != TS_LABEL) && (GetStyle() != TS_USERLABEL) &&
+  if(!GetLocalToolTip().IsEmpty() && (GetStyle() != TS_LABEL) && (GetStyle() != TS_USERLABEL) &&
      (*m_configuration)->ClipToDrawRegion() && !(*m_configuration)->GetPrinting())
   {
     wxRect rect = Cell::CropToUpdateRegion(GetRect());
@@ -426,9 +452,43 @@ void Cell::Draw(wxPoint point)
 
 void Cell::AddToolTip(const wxString &tip)
 {
-  if((!m_toolTip.IsEmpty()) && (!m_toolTip.EndsWith("\n")))
-    m_toolTip += "\n";
-  m_toolTip += tip;
+  if (tip.IsEmpty())
+    return;
+  wxString &toolTip = GetRareData().m_toolTip;
+  if((!toolTip.IsEmpty()) && (!toolTip.EndsWith("\n")))
+    toolTip += "\n";
+  toolTip += tip;
+}
+
+Cell::RareData &Cell::GetRareData()
+{
+  if (!m_rareData)
+    m_rareData.reset(new RareData);
+  return *m_rareData;
+}
+
+void Cell::SetToolTip(const wxString &tooltip)
+{
+  if (m_rareData || !tooltip.IsEmpty())
+    GetRareData().m_toolTip = tooltip;
+}
+
+const wxString &Cell::GetLocalToolTip() const
+{
+  static const wxString empty;
+  return m_rareData ? m_rareData->m_toolTip : empty;
+}
+
+void Cell::SetAltCopyText(const wxString &text)
+{
+  if (m_rareData || !text.IsEmpty())
+    GetRareData().m_altCopyText = text;
+}
+
+const wxString &Cell::GetAltCopyText() const
+{
+  static const wxString empty;
+  return m_rareData ? m_rareData->m_altCopyText : empty;
 }
 void Cell::DrawList(wxPoint point)
 {
@@ -1440,6 +1500,7 @@ Cell::CellPointers::CellPointers(wxScrolledCanvas *mathCtrl)
   m_groupCellUnderPointer = NULL;
   m_lastWorkingGroup = NULL;
   m_workingGroup = NULL;
+  m_groupWithPendingOutput = NULL;
   m_selectionStart = NULL;
   m_selectionEnd = NULL;
   m_currentTextCell = NULL;
@@ -1452,6 +1513,141 @@ wxString Cell::CellPointers::WXMXGetNewFileName()
   return file;
 }
 
+void Cell::CellPointers::WXMXAddFile(const wxString &name, const wxMemoryBuffer &data)
+{
+  if(!m_wxmxFileNames.insert(name).second)
+    return;
+  m_wxmxFiles.push_back(WXMXFile());
+  m_wxmxFiles.back().m_name = name;
+  m_wxmxFiles.back().m_data = data;
+}
+
+void Cell::CellPointers::WXMXAddGnuplotFile(const wxString &name, std::shared_ptr<Image> image,
+                                            bool data)
+{
+  if(!m_wxmxFileNames.insert(name).second)
+    return;
+  m_wxmxFiles.push_back(WXMXFile());
+  // Elements of a std::list don't move if other elements are added
+  WXMXFile *file = &m_wxmxFiles.back();
+  file->m_name = name;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp task firstprivate(image, file, data)
+  #endif
+  {
+    if(data)
+      file->m_data = image->GetGnuplotData();
+    else
+      file->m_data = image->GetGnuplotSource();
+  }
+}
+
+void Cell::CellPointers::GroupCellIndex::Rebuild(Cell *tree)
+{
+  Invalidate();
+  for(Cell *cell = tree; cell != NULL; cell = cell->m_next)
+  {
+    m_slots[cell] = m_cells.size();
+    m_cells.push_back(cell);
+    m_layoutKnown.push_back(true);
+    UpdateLayoutKnown(m_cells.size() - 1);
+  }
+}
+
+bool Cell::CellPointers::GroupCellIndex::LinksValid(size_t slot) const
+{
+  Cell *previous = NULL;
+  Cell *next = NULL;
+  if(slot > 0)
+    previous = m_cells[slot - 1];
+  if(slot + 1 < m_cells.size())
+    next = m_cells[slot + 1];
+  return (m_cells[slot]->m_previous == previous) && (m_cells[slot]->m_next == next);
+}
+
+void Cell::CellPointers::GroupCellIndex::UpdateLayoutKnown(size_t slot)
+{
+  // Cells whose size is only estimated have been stacked by UpdateYPosition()
+  // like all other cells => only cells without a size or position are a problem.
+  Cell *cell = m_cells[slot];
+  bool layoutKnown = (cell->m_height >= 0) && (cell->m_currentPoint.y >= 0);
+  if(layoutKnown == m_layoutKnown[slot])
+    return;
+  m_layoutKnown[slot] = layoutKnown;
+  if(layoutKnown)
+    m_layoutsUnknown--;
+  else
+    m_layoutsUnknown++;
+}
+
+void Cell::CellPointers::GroupCellIndex::LayoutUpdated(Cell *cell)
+{
+  if(m_cells.empty())
+    return;
+
+  SlotList::const_iterator it = m_slots.find(cell);
+  if((it == m_slots.end()) || (!LinksValid(it->second)))
+    Invalidate();
+  else
+    UpdateLayoutKnown(it->second);
+}
+
+void Cell::CellPointers::GroupCellIndex::SizeReset(Cell *cell)
+{
+  if(m_cells.empty())
+    return;
+
+  SlotList::const_iterator it = m_slots.find(cell);
+  if(it != m_slots.end())
+    UpdateLayoutKnown(it->second);
+}
+
+Cell *Cell::CellPointers::GroupCellIndex::FirstCellEndingBelow(Cell *tree, int y)
+{
+  if(tree == NULL)
+  {
+    Invalidate();
+    return NULL;
+  }
+
+  if(m_cells.empty() || (m_cells.front() != tree))
+    Rebuild(tree);
+
+  // The bottoms of cells we don't know the layout of might be out of order
+  if(m_layoutsUnknown > 0)
+  {
+    for(Cell *cell = tree; cell != NULL; cell = cell->m_next)
+      if(cell->GetRect().GetBottom() >= y)
+        return cell;
+    return NULL;
+  }
+
+  // If the list of GroupCells has changed without us being informed the
+  // neighbours of the cell we found won't match: In this case we rebuild
+  // the index and search a second time.
+  for(int pass = 0; pass < 2; pass++)
+  {
+    std::vector<Cell *>::const_iterator it =
+      std::lower_bound(m_cells.begin(), m_cells.end(), y,
+                       [](Cell *cell, int y){return cell->GetRect().GetBottom() < y;});
+    size_t slot;
+    if(it == m_cells.end())
+      slot = m_cells.size() - 1;
+    else
+      slot = it - m_cells.begin();
+
+    if(LinksValid(slot))
+    {
+      if(it == m_cells.end())
+        return NULL;
+      else
+        return *it;
+    }
+    Rebuild(tree);
+  }
+  return NULL;
+}
+
 Cell::InnerCellIterator Cell::InnerBegin() const { return {}; }
 Cell::InnerCellIterator Cell::InnerEnd() const { return {}; }
 
@@ -1466,6 +1662,8 @@ void Cell::MarkAsDeleted()
     m_cellPointers->m_workingGroup = NULL;
   if(this == m_cellPointers->m_lastWorkingGroup)
     m_cellPointers->m_lastWorkingGroup = NULL;
+  if(this == m_cellPointers->m_groupWithPendingOutput)
+    m_cellPointers->m_groupWithPendingOutput = NULL;
   if(this == m_cellPointers->m_activeCell)
     m_cellPointers->m_activeCell = NULL;
   if(this == m_cellPointers->m_currentTextCell)
@@ -38,9 +38,13 @@
 #include "Configuration.h"
 #include "TextStyle.h"
 #include <algorithm>
+#include <list>
 #include <memory>
+#include <unordered_set>
 #include <vector>
 
+class Image;
+
 /*! The supported types of math cells
  */
 enum CellType
@@ -146,13 +150,44 @@ class Cell
       }
     
     void WXMXResetCounter()
-      { m_wxmxImgCounter = 0; }
+      {
+        m_wxmxImgCounter = 0;
+        m_wxmxFiles.clear();
+        m_wxmxFileNames.clear();
+      }
     
     wxString WXMXGetNewFileName();
     
     int WXMXImageCount() const
       { return m_wxmxImgCounter; }
 
+    //! A file that is to be stored in the .wxmx archive next to content.xml
+    struct WXMXFile
+    {
+      wxString m_name;
+      //! The contents of the file. Empty means: Don't store this file.
+      wxMemoryBuffer m_data;
+    };
+    typedef std::list<WXMXFile> WXMXFileList;
+
+    //! Schedule data to be stored in the .wxmx file that is being saved
+    void WXMXAddFile(const wxString &name, const wxMemoryBuffer &data);
+    /*! Schedule the gnuplot source or data of an image to be stored in the .wxmx file
+
+      Image keeps these files in a compressed form and decompressing them is
+      slow. Therefore this is done by a background task while the xml code is
+      written. Worksheet::ExportToWXMX() waits for these tasks before it stores
+      the files.
+
+      \param name The name the file gets in the .wxmx archive
+      \param image The image the gnuplot files belong to
+      \param data true = store the gnuplot data, false = store the gnuplot source
+    */
+    void WXMXAddGnuplotFile(const wxString &name, std::shared_ptr<Image> image, bool data);
+    //! The files that have been scheduled to be stored in the .wxmx file
+    WXMXFileList &WXMXGetFiles()
+      { return m_wxmxFiles; }
+
     //! A list of editor cells containing error messages.
     class ErrorList
     {
@@ -179,6 +214,69 @@ class Cell
 
     //! The list of cells maxima has complained about errors in
     ErrorList m_errorList;
+
+    /*! An index of the worksheet's GroupCells that is ordered by their y position
+
+      Allows to find the GroupCells that touch a y coordinate using a binary search
+      instead of walking through the whole list of GroupCells. The index only
+      remembers the order of the GroupCells, not their positions, which means it
+      stays valid if GroupCells move. It is dropped if the list of GroupCells
+      changes and rebuilt on the next lookup.
+
+      The binary search relies on the bottoms of the GroupCells growing from one
+      cell to the next. This isn't guaranteed for cells that haven't been laid
+      out yet or whose size has been reset => while the index knows of such a
+      cell lookups fall back to a linear search.
+    */
+    class GroupCellIndex
+    {
+    public:
+      GroupCellIndex() = default;
+      //! Drop the index. It will be rebuilt on the next lookup.
+      void Invalidate()
+        {
+          if(!m_cells.empty())
+          {
+            m_cells.clear();
+            m_slots.clear();
+            m_layoutKnown.clear();
+            m_layoutsUnknown = 0;
+          }
+        }
+      /*! Informs the index that a GroupCell's y position or size has been updated
+
+        Drops the index if the cell's neighbours aren't the ones the index knows.
+      */
+      void LayoutUpdated(Cell *cell);
+      //! Informs the index that the size of a GroupCell is no more known
+      void SizeReset(Cell *cell);
+      /*! The first GroupCell whose bottom lies at or below y
+
+        \param tree The first GroupCell of the worksheet
+        \param y The y coordinate to search for
+        \return NULL, if all GroupCells end above y
+      */
+      Cell *FirstCellEndingBelow(Cell *tree, int y);
+    private:
+      //! Rebuilds the index from the list of GroupCells that starts with tree
+      void Rebuild(Cell *tree);
+      //! Are the neighbours of the cell at this slot still the ones the index knows?
+      bool LinksValid(size_t slot) const;
+      //! Remembers if the bottom of the cell at this slot can be used for the binary search
+      void UpdateLayoutKnown(size_t slot);
+      WX_DECLARE_VOIDPTR_HASH_MAP(size_t, SlotList);
+      //! The GroupCells in the order they appear in the worksheet
+      std::vector<Cell *> m_cells;
+      //! Which slot of m_cells each GroupCell occupies
+      SlotList m_slots;
+      //! Is the size and position of the GroupCell in the same slot of m_cells known?
+      std::vector<bool> m_layoutKnown;
+      //! The number of GroupCells whose size or position isn't known
+      size_t m_layoutsUnknown = 0;
+    };
+
+    //! The index of the GroupCells by their y position
+    GroupCellIndex m_groupCellIndex;
     //! The EditorCell the mouse selection has started in
     Cell *m_cellMouseSelectionStartedIn;
     //! The EditorCell the keyboard selection has started in
@@ -202,6 +300,11 @@ class Cell
       NULL means that maxima isn't currently evaluating a cell.
     */
     Cell *m_workingGroup;
+    /*! The GroupCell output has been appended to that still needs to be laid out
+
+      See Worksheet::InsertLine(). NULL if there is no such cell.
+    */
+    Cell *m_groupWithPendingOutput;
     /*! The currently selected string. 
 
       Since this string is defined here it is available in every editor cell
@@ -256,6 +359,9 @@ class Cell
     Cell *m_selectionEnd;
     WX_DECLARE_VOIDPTR_HASH_MAP( int, SlideShowTimersList);
     SlideShowTimersList m_slideShowTimers;
+    WX_DECLARE_VOIDPTR_HASH_MAP( int, CellsWaitingForImageList);
+    //! The cells that have been drawn with a placeholder while their image is rendered
+    CellsWaitingForImageList m_cellsWaitingForImage;
 
     wxScrolledCanvas *GetMathCtrl(){return m_mathCtrl;}
 
@@ -268,6 +374,10 @@ class Cell
     wxScrolledCanvas *m_mathCtrl;
     //! The image counter for saving .wxmx files
     int m_wxmxImgCounter;
+    //! The files that are to be stored in the .wxmx file that is being saved
+    WXMXFileList m_wxmxFiles;
+    //! The names of all files in m_wxmxFiles: Cells that share an image share its files.
+    std::unordered_set<wxString, wxStringHash, wxStringEqual> m_wxmxFileNames;
   };
 
 
@@ -310,8 +420,6 @@ class Cell
   wxAccStatus GetValue (int childId, wxString *strValue) override;
   wxAccStatus GetRole (int childId, wxAccRole *role) override;
 #endif
-  
-  wxString m_toolTip;
 
   /*! Returns the ToolTip this cell provides.
 
@@ -424,6 +532,17 @@ class Cell
    */
   void ClearCacheList();
 
+  /*! Starts creating the cached items a cell that is about to be drawn needs
+
+    Called for cells that are just outside the visible part of the worksheet:
+    Image cells start decoding their image in a background task.
+   */
+  virtual void PrefetchImage()
+  {}
+
+  //! Calls PrefetchImage() for the whole list of cells starting with this one
+  void PrefetchImageList();
+
   /*! Draw this cell
 
     \param point The x and y position this cell is drawn at: All top-level cells get their
@@ -610,7 +729,11 @@ class Cell
 
   //! Mark the cached height information as "to be calculated".
   void ResetSize()
-  { m_width = m_height = m_center = m_maxCenter = m_maxDrop = m_fullWidth = m_lineWidth = -1; }
+  {
+    m_width = m_height = m_center = m_maxCenter = m_maxDrop = m_fullWidth = m_lineWidth = -1;
+    if(m_type == MC_TYPE_GROUP)
+      m_cellPointers->m_groupCellIndex.SizeReset(this);
+  }
 
   //! Mark the cached height information of the whole list of cells as "to be calculated".
   void ResetSizeList();
@@ -822,14 +945,14 @@ class Cell
     list of cells this cell is displayed as.
    */
   virtual void SetNextToDraw(Cell *next) = 0;
-  bool m_bigSkip;
+  bool m_bigSkip:1;
   /*! true means:  This cell is broken into two or more lines.
     
     Long abs(), conjugate(), fraction and similar cells can be displayed as 2D objects,
     but will be displayed in their linear form (and therefore broken into lines) if they
     end up to be wider than the screen. In this case m_isBrokenIntoLines is true.
    */
-  bool m_isBrokenIntoLines;
+  bool m_isBrokenIntoLines:1;
   /*! True means: This cell is not to be drawn.
 
     Currently the following items fall into this category:
@@ -837,10 +960,10 @@ class Cell
      - plus signs within numbers
      - The output in folded GroupCells
    */
-  bool m_isHidden;
+  bool m_isHidden:1;
 
   //! True means: This is a hidable multiplication sign
-  bool m_isHidableMultSign;
+  bool m_isHidableMultSign:1;
 
   /*! Determine if this cell contains text that isn't code
 
@@ -964,8 +1087,9 @@ class Cell
   //! Copy common data (used when copying a cell)
   void CopyCommonData(const Cell & cell);
   //! What to put on the clipboard if this cell is to be copied as text
-  void SetAltCopyText(wxString text)
-  { m_altCopyText = text; }
+  void SetAltCopyText(const wxString &text);
+  //! The text to put on the clipboard instead of the cell's own text, if any
+  const wxString &GetAltCopyText() const;
 
   /*! Attach a copy of the list of cells that follows this one to a cell
     
@@ -981,12 +1105,14 @@ class Cell
     many => we need parenthesis cells to set this flag for the first cell in 
     their "inner cell" list.
    */
-  bool m_SuppressMultiplicationDot;
+  bool m_SuppressMultiplicationDot:1;
 
   //! Remove this cell's tooltip
-  void ClearToolTip(){m_toolTip = wxEmptyString;}
+  void ClearToolTip(){SetToolTip(wxEmptyString);}
   //! Set the tooltip of this math cell. wxEmptyString means: no tooltip.
-  void SetToolTip(const wxString &tooltip){m_toolTip = tooltip;}
+  void SetToolTip(const wxString &tooltip);
+  //! The tooltip of this cell itself, without the ones of the cells it contains
+  const wxString &GetLocalToolTip() const;
   //! Add another tooltip to this cell
   void AddToolTip(const wxString &tip);
   //! Tells this cell where it is placed on the worksheet
@@ -1037,17 +1163,14 @@ protected:
   Cell *m_parent;
 
   //! Does this cell begin with a forced page break?
-  bool m_breakPage;
+  bool m_breakPage:1;
   //! Are we allowed to add a line break before this cell?
-  bool m_breakLine;
+  bool m_breakLine:1;
   //! true means we force this cell to begin with a line break.  
-  bool m_forceBreakLine;
-  bool m_highlight;
-  /* Text that should end up on the clipboard if this cell is copied as text.
-
-     \attention  m_altCopyText is not check in all cell types!
-  */
-  wxString m_altCopyText;
+  bool m_forceBreakLine:1;
+  bool m_highlight:1;
+  //! Was this cell broken into lines at the time of the last recalculation?
+  bool m_isBrokenIntoLines_old:1;
   Configuration **m_configuration;
 
   class InnerCellIterator
@@ -1109,10 +1232,57 @@ protected:
   //! The zoom factor at the time of the last recalculation.
   double m_lastZoomFactor;
   int m_fontsize_old;
-  bool m_isBrokenIntoLines_old;
 private:
   //! The client width at the time of the last recalculation.
   int m_clientWidth_old;
+
+  /*! Data only few cells have
+
+    Most cells have neither a tooltip nor an alternate text for the clipboard.
+    Keeping both strings in every cell would make each of the many small cells
+    a big output consists of much bigger. They therefore are stored in this
+    struct that is only allocated for the cells that need it.
+   */
+  struct RareData
+  {
+    wxString m_toolTip;
+    /* Text that should end up on the clipboard if this cell is copied as text.
+
+       \attention  m_altCopyText is not check in all cell types!
+    */
+    wxString m_altCopyText;
+  };
+  //! The rarely used data of this cell. NULL if it doesn't have any.
+  std::unique_ptr<RareData> m_rareData;
+  //! Returns the rarely used data of this cell, allocating it if needed
+  RareData &GetRareData();
+};
+
+/*! Builds a list of cells and remembers where it ends
+
+  Cell::AppendCell() needs to search for the end of the list every time it is
+  called which makes building long lists using it quadratic in time. This class
+  remembers the last cell of the list it builds instead so appending a cell
+  only needs to walk the list that is appended.
+
+  The list is owned by whoever receives it via GetHead(): This class doesn't
+  delete any cells.
+ */
+class CellListBuilder
+{
+public:
+  CellListBuilder() : m_head(NULL), m_tail(NULL) {}
+  //! Continue an existing list. Needs to search for its end once.
+  explicit CellListBuilder(Cell *head);
+  //! Append a cell (or a list of cells) to the end of the list
+  void Append(Cell *cell);
+  //! The first cell of the list
+  Cell *GetHead() const { return m_head; }
+  //! The last cell of the list
+  Cell *GetTail() const { return m_tail; }
+private:
+  Cell *m_head;
+  Cell *m_tail;
 };
 
 #endif // MATHCELL_H
@@ -317,6 +317,8 @@ void ConfigDialogue::SetProperties()
           _("If this checkbox is checked wxMaxima automatically saves the file closing and every few minutes giving wxMaxima a more cellphone-app-like feel as the file is virtually always saved. If this checkbox is unchecked from time to time a backup is made in the temp folder instead."));
   m_defaultFramerate->SetToolTip(_("Define the default speed (in frames per second) animations are played back with."));
   m_maxGnuplotMegabytes->SetToolTip(_("wxMaxima normally stores the gnuplot sources for every plot made using draw() in order to be able to open plots interactively in gnuplot later. This setting defines the limit [in Megabytes per plot] for this feature."));
+  m_bitmapCacheMegabytes->SetToolTip(_("wxMaxima keeps the scaled versions of the images it has displayed recently in memory in order to be able to redraw them fast. This setting defines how much memory [in Megabytes] these images may use."));
+  m_undoMegabytes->SetToolTip(_("wxMaxima remembers the changes made to each input cell in order to be able to undo them. This setting defines how much memory [in Megabytes per cell] this history may use: If it needs more the oldest changes are forgotten."));
   m_defaultPlotWidth->SetToolTip(
           _("The default width for embedded plots. Can be read out or overridden by the maxima variable wxplot_size"));
   m_defaultPlotHeight->SetToolTip(
@@ -485,6 +487,8 @@ void ConfigDialogue::SetProperties()
   m_restartOnReEvaluation->SetValue(configuration->RestartOnReEvaluation());
   m_defaultFramerate->SetValue(defaultFramerate);
   m_maxGnuplotMegabytes->SetValue(configuration->MaxGnuplotMegabytes());
+  m_bitmapCacheMegabytes->SetValue(configuration->BitmapCacheMegabytes());
+  m_undoMegabytes->SetValue(configuration->UndoMegabytes());
   m_defaultPlotWidth->SetValue(defaultPlotWidth);
   m_defaultPlotHeight->SetValue(defaultPlotHeight);
   m_displayedDigits->SetValue(configuration->GetDisplayedDigits());
@@ -876,6 +880,20 @@ wxPanel *ConfigDialogue::CreateOptionsPanel()
   grid_sizer->Add(mm, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
   grid_sizer->Add(m_maxGnuplotMegabytes, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
 
+  wxStaticText *bc = new wxStaticText(panel, -1, _("Memory for displayed images [MB]:"));
+  m_bitmapCacheMegabytes = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(150*GetContentScaleFactor(), -1), wxSP_ARROW_KEYS, 1,
+                                          20000);
+  
+  grid_sizer->Add(bc, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  grid_sizer->Add(m_bitmapCacheMegabytes, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+
+  wxStaticText *um = new wxStaticText(panel, -1, _("Undo memory limit [MB/cell]:"));
+  m_undoMegabytes = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(150*GetContentScaleFactor(), -1), wxSP_ARROW_KEYS, 1,
+                                   2000);
+  
+  grid_sizer->Add(um, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  grid_sizer->Add(m_undoMegabytes, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+
   vsizer->Add(grid_sizer, 1, wxEXPAND, 5);
   
   m_savePanes = new wxCheckBox(panel, -1, _("Save panes layout"));
@@ -1193,6 +1211,8 @@ void ConfigDialogue::WriteSettings()
   configuration->AntiAliasLines(m_antialiasLines->GetValue());
   config->Write(wxT("DefaultFramerate"), m_defaultFramerate->GetValue());
   configuration->MaxGnuplotMegabytes(m_maxGnuplotMegabytes->GetValue());
+  configuration->BitmapCacheMegabytes(m_bitmapCacheMegabytes->GetValue());
+  configuration->UndoMegabytes(m_undoMegabytes->GetValue());
   config->Write(wxT("defaultPlotWidth"), m_defaultPlotWidth->GetValue());
   config->Write(wxT("defaultPlotHeight"), m_defaultPlotHeight->GetValue());
   configuration->SetDisplayedDigits(m_displayedDigits->GetValue());
@@ -330,6 +330,10 @@ protected:
   wxSpinCtrl *m_defaultPort;
   ExamplePanel *m_examplePanel;
   wxSpinCtrl *m_maxGnuplotMegabytes;
+  //! The memory the scaled images in the worksheet may need
+  wxSpinCtrl *m_bitmapCacheMegabytes;
+  //! The memory the undo history of a cell may need
+  wxSpinCtrl *m_undoMegabytes;
 
   //! Is called when the path to the maxima binary was changed.
   void MaximaLocationChanged(wxCommandEvent &unused);
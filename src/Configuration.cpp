@@ -28,6 +28,7 @@
 #include "Dirstructure.h"
 #include "ErrorRedirector.h"
 #include "FontCache.h"
+#include "BitmapCache.h"
 #include <wx/wx.h>
 #include <wx/string.h>
 #include <wx/font.h>
@@ -79,6 +80,8 @@ Configuration::Configuration(wxDC *dc) :
   m_abortOnError = true;
   m_defaultPort = 49152;
   m_maxGnuplotMegabytes = 12;
+  m_bitmapCacheMegabytes = 200;
+  m_undoMegabytes = 10;
   m_clientWidth = 1024;
   m_clientHeight = 768;
   m_indentMaths=true;
@@ -349,6 +352,14 @@ void Configuration::ShowCodeCells(bool show)
   m_showCodeCells = show;
 }
 
+void Configuration::BitmapCacheMegabytes(long megaBytes)
+{
+  if (megaBytes < 1)
+    megaBytes = 1;
+  wxConfig::Get()->Write("bitmapCacheMegabytes", m_bitmapCacheMegabytes = megaBytes);
+  BitmapCache::Get().SetMaxBytes(m_bitmapCacheMegabytes * 1000 * 1000);
+}
+
 void Configuration::SetBackgroundBrush(wxBrush brush)
 {
   m_BackgroundBrush = brush;
@@ -400,6 +411,13 @@ void Configuration::ReadConfig()
 
   config->Read("invertBackground", &m_invertBackground);
   config->Read("maxGnuplotMegabytes", &m_maxGnuplotMegabytes);
+  config->Read("bitmapCacheMegabytes", &m_bitmapCacheMegabytes);
+  if (m_bitmapCacheMegabytes < 1)
+    m_bitmapCacheMegabytes = 1;
+  BitmapCache::Get().SetMaxBytes(m_bitmapCacheMegabytes * 1000 * 1000);
+  config->Read("undoMegabytes", &m_undoMegabytes);
+  if (m_undoMegabytes < 1)
+    m_undoMegabytes = 1;
   config->Read("offerKnownAnswers", &m_offerKnownAnswers);
   config->Read(wxT("documentclass"), &m_documentclass);
   config->Read(wxT("documentclassoptions"), &m_documentclassOptions);
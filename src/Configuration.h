@@ -831,6 +831,15 @@ public:
   void MaxGnuplotMegabytes(long megaBytes)
     {wxConfig::Get()->Write("maxGnuplotMegabytes",m_maxGnuplotMegabytes = megaBytes);}
 
+  //! The maximum number of Megabytes the scaled images in the worksheet may need
+  long BitmapCacheMegabytes() const {return m_bitmapCacheMegabytes;}
+  void BitmapCacheMegabytes(long megaBytes);
+
+  //! The maximum number of Megabytes the undo history of a cell may need
+  long UndoMegabytes() const {return m_undoMegabytes;}
+  void UndoMegabytes(long megaBytes)
+    {wxConfig::Get()->Write("undoMegabytes",m_undoMegabytes = wxMax(megaBytes, 1));}
+
   bool OfferKnownAnswers() const {return m_offerKnownAnswers;}
   void OfferKnownAnswers(bool offerKnownAnswers)
     {wxConfig::Get()->Write("offerKnownAnswers",m_offerKnownAnswers = offerKnownAnswers);}
@@ -993,6 +1002,8 @@ private:
   bool m_offerKnownAnswers;
   long m_defaultPort;
   long m_maxGnuplotMegabytes;
+  long m_bitmapCacheMegabytes;
+  long m_undoMegabytes;
   wxString m_documentclass;
   wxString m_documentclassOptions;
   htmlExportFormat m_htmlEquationFormat;
@@ -0,0 +1,183 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+
+  This file defines the class DirectoryIndex that remembers the contents of
+  directories.
+ */
+
+#include "DirectoryIndex.h"
+#include "CacheFile.h"
+#include <wx/filename.h>
+
+//! The version of the format of the file DirectoryIndex is saved to
+#define DIRECTORYINDEX_VERSION 1
+/*! The resolution of the modification times of directories, in milliseconds
+
+  FAT only stores modification times with a resolution of 2 seconds.
+*/
+#define DIRECTORYINDEX_MTIME_RESOLUTION 2000
+
+const DirectoryIndex::Listing *DirectoryIndex::Get(const wxString &dir)
+{
+  wxFileName dirName = wxFileName::DirName(dir);
+  wxDateTime modificationTime = dirName.GetModificationTime();
+  if(!modificationTime.IsValid())
+  {
+    m_listings.erase(dir);
+    return NULL;
+  }
+
+  Listing &listing = m_listings[dir];
+  listing.m_used = true;
+  if((listing.m_modificationTime != 0) &&
+     (listing.m_modificationTime == modificationTime.GetValue().GetValue()))
+    return &listing;
+
+  // A file that is added to the directory within the resolution of the modification
+  // time after it has been modified might not change the modification time
+  // => We can only rely on the listing if it has been modified long enough ago.
+  bool reliable = (wxDateTime::UNow() - modificationTime).GetMilliseconds() >=
+    DIRECTORYINDEX_MTIME_RESOLUTION;
+
+  wxDir directory(dir);
+  if(!directory.IsOpened())
+  {
+    m_listings.erase(dir);
+    return NULL;
+  }
+  listing.m_files.Clear();
+  listing.m_dirs.Clear();
+  wxString name;
+  for(bool found = directory.GetFirst(&name, wxEmptyString, wxDIR_FILES | wxDIR_HIDDEN);
+      found; found = directory.GetNext(&name))
+    listing.m_files.Add(name);
+  for(bool found = directory.GetFirst(&name, wxEmptyString, wxDIR_DIRS | wxDIR_HIDDEN);
+      found; found = directory.GetNext(&name))
+    listing.m_dirs.Add(name);
+  if(reliable)
+    listing.m_modificationTime = modificationTime.GetValue().GetValue();
+  else
+    listing.m_modificationTime = 0;
+  m_changed = true;
+  return &listing;
+}
+
+void DirectoryIndex::Traverse(const wxString &dir, wxDirTraverser &sink)
+{
+  wxString path = dir;
+  if(!path.IsEmpty() && !wxFileName::IsPathSeparator(path.Last()))
+    path += wxFILE_SEP_PATH;
+  Traverse_Recursive(path, sink);
+}
+
+wxDirTraverseResult DirectoryIndex::Traverse_Recursive(const wxString &dir, wxDirTraverser &sink)
+{
+  const Listing *listing = Get(dir);
+  if(listing == NULL)
+    return wxDIR_CONTINUE;
+
+  // Copy the names: Get() might change the listing while we traverse the subdirectories
+  wxArrayString dirs = listing->m_dirs;
+  wxArrayString files = listing->m_files;
+
+  // Like wxDir::Traverse() we visit the subdirectories first
+  for(auto const &subdir : dirs)
+  {
+    wxString path = dir + subdir;
+    switch(sink.OnDir(path))
+    {
+    case wxDIR_STOP:
+      return wxDIR_STOP;
+    case wxDIR_CONTINUE:
+      if(Traverse_Recursive(path + wxFILE_SEP_PATH, sink) == wxDIR_STOP)
+        return wxDIR_STOP;
+      break;
+    default:
+      break;
+    }
+  }
+  for(auto const &file : files)
+  {
+    if(sink.OnFile(dir + file) == wxDIR_STOP)
+      return wxDIR_STOP;
+  }
+  return wxDIR_CONTINUE;
+}
+
+bool DirectoryIndex::Load(const wxString &file)
+{
+  CacheFileReader cache(file, wxT("wxMaxima directory index"), DIRECTORYINDEX_VERSION);
+  wxDataInputStream &data = cache.Data();
+
+  std::unordered_map<wxString, Listing, wxStringHash, wxStringEqual> listings;
+  wxUint32 numDirs = cache.IsOk() ? data.Read32() : 0;
+  for(wxUint32 i = 0; (i < numDirs) && cache.IsOk(); i++)
+  {
+    Listing &listing = listings[data.ReadString()];
+    listing.m_modificationTime = data.Read64();
+    wxUint32 numFiles = data.Read32();
+    for(wxUint32 j = 0; (j < numFiles) && cache.IsOk(); j++)
+      listing.m_files.Add(data.ReadString());
+    wxUint32 numSubdirs = data.Read32();
+    for(wxUint32 j = 0; (j < numSubdirs) && cache.IsOk(); j++)
+      listing.m_dirs.Add(data.ReadString());
+  }
+  if(!cache.End())
+    return false;
+
+  m_listings = std::move(listings);
+  m_changed = false;
+  return true;
+}
+
+void DirectoryIndex::Save(const wxString &file)
+{
+  if(!m_changed)
+    return;
+
+  CacheFileWriter cache(file, wxT("wxMaxima directory index"), DIRECTORYINDEX_VERSION);
+  if(!cache.IsOk())
+    return;
+  wxDataOutputStream &data = cache.Data();
+  wxUint32 numDirs = 0;
+  for(auto const &listing : m_listings)
+    if(listing.second.m_used && (listing.second.m_modificationTime != 0))
+      numDirs++;
+  data.Write32(numDirs);
+  for(auto const &listing : m_listings)
+  {
+    if(!listing.second.m_used || (listing.second.m_modificationTime == 0))
+      continue;
+    data.WriteString(listing.first);
+    data.Write64(listing.second.m_modificationTime);
+    data.Write32(listing.second.m_files.GetCount());
+    for(auto const &name : listing.second.m_files)
+      data.WriteString(name);
+    data.Write32(listing.second.m_dirs.GetCount());
+    for(auto const &name : listing.second.m_dirs)
+      data.WriteString(name);
+  }
+  if(cache.Commit())
+    m_changed = false;
+}
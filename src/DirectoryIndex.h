@@ -0,0 +1,102 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+
+  This file declares the class DirectoryIndex that remembers the contents of
+  directories.
+ */
+
+#ifndef DIRECTORYINDEX_H
+#define DIRECTORYINDEX_H
+
+#include <wx/string.h>
+#include <wx/arrstr.h>
+#include <wx/dir.h>
+#include <wx/hashmap.h>
+#include <unordered_map>
+
+/*! Remembers which files and subdirectories directories contain
+
+  Reading a directory from a slow disk or a network drive can take long.
+  But adding, removing or renaming a file in a directory changes the modification
+  time of the directory. This means that the contents of a directory only need
+  to be read again if its modification time has changed.
+
+  The index can be saved to a file and loaded in the next session so the
+  directories that are scanned at every start only need to be read if they
+  have changed.
+*/
+class DirectoryIndex
+{
+public:
+  /*! Calls the sink for all files and subdirectories of dir, as wxDir::Traverse() does
+
+    The subdirectories are traversed, too, unless the sink asks not to.
+    Only the directories whose modification time has changed are read from disk.
+  */
+  void Traverse(const wxString &dir, wxDirTraverser &sink);
+
+  /*! Reads the index from a file
+
+    \return false, if the file doesn't exist or isn't an index.
+  */
+  bool Load(const wxString &file);
+  /*! Writes the directories that have been used since the index was loaded to a file
+
+    Does nothing if none of these directories has changed.
+  */
+  void Save(const wxString &file);
+
+private:
+  //! What a directory contains
+  struct Listing
+  {
+    /*! The modification time of the directory at the time it was read
+
+      0, if the directory has been modified so recently that the listing has to
+      be read again the next time it is needed.
+    */
+    wxLongLong_t m_modificationTime = 0;
+    //! The names of the files in the directory
+    wxArrayString m_files;
+    //! The names of the subdirectories
+    wxArrayString m_dirs;
+    //! Has the directory been used since the index was loaded?
+    bool m_used = false;
+  };
+
+  /*! Returns what dir contains
+
+    \return NULL, if dir cannot be read.
+  */
+  const Listing *Get(const wxString &dir);
+  //! Traverse() without the check if dir exists
+  wxDirTraverseResult Traverse_Recursive(const wxString &dir, wxDirTraverser &sink);
+
+  //! The directories we know the contents of, by their path
+  std::unordered_map<wxString, Listing, wxStringHash, wxStringEqual> m_listings;
+  //! Have directories been read from disk since the index was loaded?
+  bool m_changed = false;
+};
+
+#endif // DIRECTORYINDEX_H
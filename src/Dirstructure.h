@@ -75,6 +75,14 @@ public:
    */
   wxString UserAutocompleteFile();
 
+  //! The file the anchors of maxima's manual are cached in
+  wxString HelpFileAnchorsCacheFile() const
+  { return UserConfDir() + wxT("wxmaxima_helpanchors.cache"); }
+
+  //! The file the contents of the directories autocompletion scans are cached in
+  wxString DirectoryIndexFile() const
+  { return UserConfDir() + wxT("wxmaxima_directories.cache"); }
+
   //! The path to wxMaxima's own AutoComplete file
   wxString AutocompleteFile() const
   { return DataDir() + wxT("/autocomplete.txt"); }
@@ -32,6 +32,7 @@
 
 #include "EditorCell.h"
 #include "FontCache.h"
+#include "TextExtentCache.h"
 #include "wxMaxima.h"
 #include "MarkDown.h"
 #include "wxMaximaFrame.h"
@@ -71,6 +72,8 @@ EditorCell::EditorCell(Cell *parent, Configuration **config,
   m_containsChanges = false;
   m_containsChangesCheck = false;
   m_firstLineOnly = false;
+  m_tokensInLispMode = false;
+  m_tokensChangeAsterisk = false;
   m_historyPosition = -1;
   SetValue(TabExpand(text, 0));
   ResetSize();  
@@ -263,12 +266,9 @@ wxString EditorCell::PrependNBSP(wxString input)
   return retval;
 }
 
-// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_wordList
 // cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_styledText
-// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_textHistory
-// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_positionHistory
-// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_startHistory
-// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_endHistory
+// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_history
+// cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_historyText
 // cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_fontName
 // cppcheck-suppress uninitMemberVar symbolName=EditorCell::m_tokens
 EditorCell::EditorCell(const EditorCell &cell):
@@ -644,7 +644,7 @@ void EditorCell::RecalculateWidths(int fontsize)
 
     // We want a little bit of vertical space between two text lines (and between two labels).
     m_charHeight += 2 * MC_TEXT_PADDING;
-    int width = 0, tokenwidth, tokenheight, linewidth = 0;
+    int width = 0, linewidth = 0;
 
     m_numberOfLines = 1;
 
@@ -663,8 +663,7 @@ void EditorCell::RecalculateWidths(int fontsize)
       }
       else
       {
-        dc->GetTextExtent(textSnippet->GetText(), &tokenwidth, &tokenheight);
-        linewidth += tokenwidth;
+        linewidth += GetTextSize(textSnippet->GetText()).GetWidth();
         width = wxMax(width, linewidth);
       }
     }
@@ -1098,7 +1097,7 @@ wxSize EditorCell::GetTextSize(wxString const &text)
     return it->second;
 
   // Ask wxWidgets to return this text piece's size (slow!)
-  wxSize sz = dc->GetTextExtent(text);
+  wxSize sz = TextExtentCache::GetATextExtent(dc, text);
   m_widths[text] = sz;
   return sz;
 }
@@ -2263,15 +2262,7 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
   if(keyCode == ' ')
     m_widths.clear();
 
-  if (m_historyPosition != -1)
-  {
-    int len = m_textHistory.GetCount() - m_historyPosition;
-    m_textHistory.RemoveAt(m_historyPosition + 1, len - 1);
-    m_startHistory.erase(m_startHistory.begin() + m_historyPosition + 1, m_startHistory.end());
-    m_endHistory.erase(m_endHistory.begin() + m_historyPosition + 1, m_endHistory.end());
-    m_positionHistory.erase(m_positionHistory.begin() + m_historyPosition + 1, m_positionHistory.end());
-    m_historyPosition = -1;
-  }
+  DiscardRedoSteps();
 
   // if we have a selection either put parens around it (and don't write the letter afterwards)
   // or delete selection and write letter (insertLetter = true).
@@ -3279,31 +3270,36 @@ int EditorCell::GetLineWidth(unsigned int line, int pos)
 
 bool EditorCell::CanUndo()
 {
-  return m_textHistory.GetCount() > 0 && m_historyPosition != 0;
+  return !m_history.empty() && m_historyPosition != 0;
 }
 
 void EditorCell::Undo()
 {
+  // If the text has been edited after an Undo() the history cannot be
+  // navigated from here: Start a new branch of it.
+  if ((m_historyPosition != -1) && (m_text != m_historyText))
+    DiscardRedoSteps();
+
   if (m_historyPosition == -1)
   {
-    m_historyPosition = m_textHistory.GetCount() - 1;
-    m_textHistory.Add(m_text);
-    m_startHistory.push_back(m_selectionStart);
-    m_endHistory.push_back(m_selectionEnd);
-    m_positionHistory.push_back(m_positionOfCaret);
+    // Remember the current state so Redo() can return to it.
+    AppendToHistory();
+    m_historyPosition = m_history.size() - 1;
   }
-  else
-    m_historyPosition--;
 
-  if (m_historyPosition == -1)
+  if (m_historyPosition <= 0)
     return;
 
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  m_text = m_textHistory.Item(m_historyPosition);
+  const UndoStep &undone = m_history[m_historyPosition];
+  m_text.replace(undone.m_start, undone.m_inserted.Length(), undone.m_removed);
+  m_historyText = m_text;
+  m_historyPosition--;
   StyleText();
 
-  m_positionOfCaret = m_positionHistory[m_historyPosition];
-  SetSelection(m_startHistory[m_historyPosition], m_endHistory[m_historyPosition]);
+  const UndoStep &state = m_history[m_historyPosition];
+  m_positionOfCaret = state.m_positionOfCaret;
+  SetSelection(state.m_selectionStart, state.m_selectionEnd);
 
   m_paren1 = m_paren2 = -1;
   m_isDirty = true;
@@ -3313,27 +3309,30 @@ void EditorCell::Undo()
 
 bool EditorCell::CanRedo()
 {
-  return m_textHistory.GetCount() > 0 &&
+  return !m_history.empty() &&
          m_historyPosition >= 0 &&
-         m_historyPosition < ((long) m_textHistory.GetCount()) - 1;
+         m_historyPosition < ((long) m_history.size()) - 1;
 }
 
 void EditorCell::Redo()
 {
-  if (m_historyPosition == -1)
+  if (!CanRedo())
     return;
 
-  m_historyPosition++;
-
-  if (m_historyPosition >= (long) m_textHistory.GetCount())
+  // The steps that follow describe changes to the text we have returned to.
+  if (m_text != m_historyText)
     return;
 
+  m_historyPosition++;
+
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  m_text = m_textHistory.Item(m_historyPosition);
+  const UndoStep &state = m_history[m_historyPosition];
+  m_text.replace(state.m_start, state.m_removed.Length(), state.m_inserted);
+  m_historyText = m_text;
   StyleText();
 
-  m_positionOfCaret = m_positionHistory[m_historyPosition];
-  SetSelection(m_startHistory[m_historyPosition], m_endHistory[m_historyPosition]);
+  m_positionOfCaret = state.m_positionOfCaret;
+  SetSelection(state.m_selectionStart, state.m_selectionEnd);
 
   m_paren1 = m_paren2 = -1;
   m_isDirty = true;
@@ -3343,34 +3342,88 @@ void EditorCell::Redo()
 
 void EditorCell::SaveValue()
 {
-  if (m_textHistory.GetCount() > 0)
+  if (!m_history.empty() && (m_text == m_historyText))
+    return;
+
+  DiscardRedoSteps();
+  AppendToHistory();
+}
+
+void EditorCell::AppendToHistory()
+{
+  UndoStep step;
+  step.m_positionOfCaret = m_positionOfCaret;
+  step.m_selectionStart = m_selectionStart;
+  step.m_selectionEnd = m_selectionEnd;
+
+  // The oldest state has no state it could be undone to.
+  if (!m_history.empty())
   {
-    if (m_textHistory.Last() == m_text)
-      return;
+    // Find the span in which the text differs from the previous state's text
+    size_t oldLength = m_historyText.Length();
+    size_t newLength = m_text.Length();
+    size_t start = 0;
+    wxString::const_iterator oldChar = m_historyText.begin();
+    wxString::const_iterator newChar = m_text.begin();
+    while ((oldChar != m_historyText.end()) && (newChar != m_text.end()) &&
+           (*oldChar == *newChar))
+    {
+      ++oldChar;
+      ++newChar;
+      ++start;
+    }
+    size_t maxSuffix = wxMin(oldLength, newLength) - start;
+    size_t suffix = 0;
+    wxString::const_reverse_iterator oldRChar = m_historyText.rbegin();
+    wxString::const_reverse_iterator newRChar = m_text.rbegin();
+    while ((suffix < maxSuffix) && (*oldRChar == *newRChar))
+    {
+      ++oldRChar;
+      ++newRChar;
+      ++suffix;
+    }
+    step.m_start = start;
+    step.m_removed = m_historyText.Mid(start, oldLength - start - suffix);
+    step.m_inserted = m_text.Mid(start, newLength - start - suffix);
   }
 
-  if (m_historyPosition != -1)
+  m_historyBytes += step.GetSize();
+  m_history.push_back(std::move(step));
+  m_historyText = m_text;
+  m_historyPosition = -1;
+
+  // Drop the oldest states until the history fits into its memory budget
+  size_t maxBytes = (*m_configuration)->UndoMegabytes() * 1000 * 1000;
+  while ((m_historyBytes > maxBytes) && (m_history.size() > 1))
   {
-    int len = m_textHistory.GetCount() - m_historyPosition;
-    m_textHistory.RemoveAt(m_historyPosition, len);
-    m_startHistory.erase(m_startHistory.begin() + m_historyPosition, m_startHistory.end());
-    m_endHistory.erase(m_endHistory.begin() + m_historyPosition, m_endHistory.end());
-    m_positionHistory.erase(m_positionHistory.begin() + m_historyPosition, m_positionHistory.end());
+    m_historyBytes -= m_history.front().GetSize();
+    m_history.pop_front();
+    UndoStep &oldest = m_history.front();
+    m_historyBytes -= oldest.GetSize();
+    wxString().swap(oldest.m_removed);
+    wxString().swap(oldest.m_inserted);
+    m_historyBytes += oldest.GetSize();
   }
+}
 
-  m_textHistory.Add(m_text);
-  m_startHistory.push_back(m_selectionStart);
-  m_endHistory.push_back(m_selectionEnd);
-  m_positionHistory.push_back(m_positionOfCaret);
+void EditorCell::DiscardRedoSteps()
+{
+  if (m_historyPosition == -1)
+    return;
+
+  while ((ptrdiff_t) m_history.size() > m_historyPosition + 1)
+  {
+    m_historyBytes -= m_history.back().GetSize();
+    m_history.pop_back();
+  }
   m_historyPosition = -1;
 }
 
 void EditorCell::ClearUndo()
 {
-  m_textHistory.Clear();
-  m_startHistory.clear();
-  m_endHistory.clear();
-  m_positionHistory.clear();
+  m_history.clear();
+  m_historyText.Clear();
+  m_historyBytes = 0;
   m_historyPosition = -1;
 }
 
@@ -3440,20 +3493,58 @@ void EditorCell::StyleTextCode()
     }
   }
 
-  // Split the line into commands, numbers etc.
-  m_tokens = MaximaTokenizer(textToStyle, *m_configuration).PopTokens();
+  // Split the line into commands, numbers etc. - if we don't know the tokens, already.
+  if ((m_tokensInLispMode != (*m_configuration)->InLispMode()) ||
+      (m_tokensChangeAsterisk != (*m_configuration)->GetChangeAsterisk()))
+    SetTokens(textToStyle, MaximaTokenizer(textToStyle, *m_configuration).PopTokens());
+  else if (textToStyle != m_tokensText)
+  {
+    // Only the lines that have been changed need to be tokenized again
+    MaximaTokenizer tokenizer(textToStyle, *m_configuration, m_tokensText, std::move(m_tokens));
+    size_t unchangedTokens = tokenizer.GetUnchangedTokens();
+    SetTokens(textToStyle, std::move(tokenizer).PopTokens(), unchangedTokens);
+  }
 
-  // Now handle the text pieces one by one
-  wxString lastTokenWithText;
+  // The styled text for the lines in front of the first changed token can be
+  // kept, if it has been created for the same font and line width. As hard line
+  // breaks end the line the soft line breaks are calculated for the lines after
+  // it doesn't depend on them.
+  StyleKey styleKey = {(*m_configuration)->GetLineWidth(), m_fontSize, m_textStyle,
+                       (*m_configuration)->GetAutoWrapCode(), m_autoAnswer, m_firstLineOnly};
+  size_t firstToken = 0;
+  if (styleKey == m_styledTextKey)
+    firstToken = m_tokenStyledText.size();
+  else
+    m_tokenStyledText.clear();
+  m_styledTextKey = styleKey;
   int pos = 0;
+  if (firstToken > 0)
+  {
+    m_styledText.resize(m_tokenStyledText[firstToken - 1]);
+    // Restore the soft line breaks StyleText() has removed from m_text
+    for (auto const &textSnippet : m_styledText)
+    {
+      if ((textSnippet.GetText() == wxT("\r")) && (pos < (int) m_text.Length()))
+        m_text[pos] = wxT('\r');
+      pos += textSnippet.GetText().Length();
+    }
+  }
+  else
+    m_styledText.clear();
+
+  // Now handle the text pieces one by one
   int lineWidth = 0;
 
-  for (auto const &token : m_tokens)
+  m_tokenStyledText.reserve(m_tokens.size());
+  for (auto token = m_tokens.begin() + firstToken; token != m_tokens.end(); ++token)
   {
-    pos += token.GetText().Length();
-    auto &tokenString = token.GetText();
+    pos += token->GetText().Length();
+    auto &tokenString = token->GetText();
     if (tokenString.IsEmpty())
+    {
+      m_tokenStyledText.push_back(m_styledText.size());
       continue;
+    }
     wxChar Ch = tokenString[0];
     
     // Handle Spaces
@@ -3468,45 +3559,61 @@ void EditorCell::StyleTextCode()
       // space as the space that potentially serves as the next point to
       // introduce a soft line break.
       m_styledText.push_back(StyledText(wxT(" ")));
-      if (!m_styledText.empty())
-      {
-        lastSpace = &m_styledText.back();
-        lastSpacePos = pos + tokenString.Length() - 1;
-      }
-      else
-      {
-        lastSpace = NULL;
-        lastSpacePos = 0;
-      }      
+      lastSpace = &m_styledText.back();
+      lastSpacePos = pos - 1;
+      m_tokenStyledText.push_back(m_styledText.size());
       continue;
     }
     
     // Most of the other item types can contain Newlines - that we want as separate tokens
-    wxString txt = tokenString;
     wxString line;
-    for (wxString::const_iterator it2 = txt.begin(); it2 < txt.end(); ++it2)
+    for (wxString::const_iterator it2 = tokenString.begin(); it2 < tokenString.end(); ++it2)
     {
       if(*it2 != '\n')
         line +=wxString(*it2);
       else
       {
         if(line != wxEmptyString)
-          m_styledText.push_back(StyledText(token.GetStyle(), line));
-        m_styledText.push_back(StyledText(token.GetStyle(), "\n"));
+          m_styledText.push_back(StyledText(token->GetStyle(), line));
+        m_styledText.push_back(StyledText(token->GetStyle(), "\n"));
         line = wxEmptyString;
       }
     }
     if(line != wxEmptyString)
-      m_styledText.push_back(StyledText(token.GetStyle(), line));
-    HandleSoftLineBreaks_Code(lastSpace, lineWidth, token, pos, m_text, lastSpacePos,
+      m_styledText.push_back(StyledText(token->GetStyle(), line));
+    HandleSoftLineBreaks_Code(lastSpace, lineWidth, tokenString, pos, m_text, lastSpacePos,
                               indentationPixels);
-    if ((token.GetStyle() == TS_CODE_VARIABLE) || (token.GetStyle() == TS_CODE_FUNCTION))
+    // A hard line break starts a new line
+    if (tokenString == wxT("\n"))
     {
-      m_wordList.Add(token);
-      continue;
+      lastSpace = NULL;
+      lineWidth = 0;
+      indentationPixels = 0;
     }
+    m_tokenStyledText.push_back(m_styledText.size());
   }
-  m_wordList.Sort();
+}
+
+wxArrayString EditorCell::GetWordList() const
+{
+  wxArrayString wordList;
+  for (auto const &token : m_tokens)
+    if (((token.GetStyle() == TS_CODE_VARIABLE) || (token.GetStyle() == TS_CODE_FUNCTION)) &&
+        !token.GetText().IsEmpty())
+      wordList.Add(token);
+  wordList.Sort();
+  return wordList;
+}
+
+void EditorCell::SetTokens(const wxString &text, MaximaTokenizer::TokenList &&tokens,
+                           size_t unchangedTokens)
+{
+  m_tokens = std::move(tokens);
+  m_tokensText = text;
+  m_tokensInLispMode = (*m_configuration)->InLispMode();
+  m_tokensChangeAsterisk = (*m_configuration)->GetChangeAsterisk();
+  if (m_tokenStyledText.size() > unchangedTokens)
+    m_tokenStyledText.resize(unchangedTokens);
 }
 
 void EditorCell::StyleTextTexts()
@@ -3802,11 +3909,12 @@ void EditorCell::StyleText()
   SetFont();
 
 
-  m_wordList.Clear();
-  m_styledText.clear();
-
   if(m_text == wxEmptyString)
+  {
+    m_styledText.clear();
+    m_tokenStyledText.clear();
     return;
+  }
 
   // Remove all soft line breaks. They will be re-added in the right places
   // in the next step
@@ -3815,7 +3923,11 @@ void EditorCell::StyleText()
   if (m_type == MC_TYPE_INPUT)
     StyleTextCode();
   else
+  {
+    m_styledText.clear();
+    m_tokenStyledText.clear();
     StyleTextTexts();
+  }
 }
 
 
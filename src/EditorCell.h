@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <list>
+#include <deque>
 #include "MaximaTokenizer.h"
 
 /*! \file
@@ -68,9 +69,6 @@ private:
 
   int m_errorIndex;
 
-  //! A list of all potential autoComplete targets within this cell
-  wxArrayString m_wordList;
-
   //! Draw a box that marks the current selection
   void MarkSelection(long start, long end, TextStyle style, int fontsize);
 
@@ -182,8 +180,7 @@ public:
   { m_cellPointers->m_selectionString = string; }
 
   //! A list of words that might be applicable to the autocomplete function.
-  wxArrayString GetWordList() const
-  { return m_wordList; }
+  wxArrayString GetWordList() const;
 
   //! Has the selection changed since the last draw event?
   bool m_selectionChanged;
@@ -268,14 +265,18 @@ public:
 
   /*! Converts m_text to a list of styled text snippets that will later be displayed by draw().
 
-    This function also generates a wordlist for this EditorCell so Autocompletion can learn
+    The tokens of code cells are also used by GetWordList() so Autocompletion can learn
     about variable names contained in lists or cells that still haven't been evaluated.
 
     For cells containing text instead of code this function adds a <code>\\r</code> as a marker
     that this line is to be broken here until the window's width changes.
    */
   void StyleText();
-  /*! Is Called by StyleText() if this is a code cell */
+  /*! Is Called by StyleText() if this is a code cell
+
+    Only tokenizes and styles the lines starting with the first line that has
+    been changed since the last call.
+   */
   void StyleTextCode();
   void StyleTextTexts();
 
@@ -403,6 +404,9 @@ public:
     StyleText();
   }
 
+  //! Does this cell only show its first line?
+  bool IsFirstLineOnly() const { return m_firstLineOnly; }
+
   bool IsActive() const override
   { return this == m_cellPointers->m_activeCell; }
 
@@ -563,6 +567,18 @@ public:
   //! Get the lost of commands, parenthesis, strings and whitespaces in a code cell
   const MaximaTokenizer::TokenList &GetTokens() const {return m_tokens;}
 
+  /*! Tell this cell which tokens the code text consists of
+
+    Allows to tokenize code in a background task: StyleText() only tokenizes
+    the code itself if its text differs from text or if the settings that
+    influence the tokenizer have changed since the tokens were created.
+
+    \param unchangedTokens The number of tokens at the start of tokens that
+    are the same as the ones this cell has styled the last time.
+  */
+  void SetTokens(const wxString &text, MaximaTokenizer::TokenList &&tokens,
+                 size_t unchangedTokens = 0);
+
   void SetNextToDraw(Cell *next) override;
 
   Cell *GetNextToDraw() const override {return m_nextToDraw;}
@@ -573,6 +589,7 @@ protected:
       ResetSize();
       ResetData();
       m_widths.clear();
+      m_tokenStyledText.clear();
     }
 private:
   Cell *m_nextToDraw = {};
@@ -713,12 +730,51 @@ private:
    */
   wxString InterpretEscapeString(const wxString &txt) const;
 
+  /*! Appends the current text, caret and selection to the undo history
+
+    Only the part of the text that differs from m_historyText is stored. If the
+    history needs more memory than the configuration allows the oldest states
+    are dropped.
+   */
+  void AppendToHistory();
+  //! Drops the states Redo() could return to, after an Undo()
+  void DiscardRedoSteps();
+
+  /*! One state of the text in the undo history
+
+    Instead of a copy of the whole text each state only stores how the text
+    differs from the text of the state before it: Replacing m_removed at
+    m_start by m_inserted turns the previous state's text into this state's
+    text, and the reverse operation undoes this step.
+   */
+  struct UndoStep
+  {
+    //! The first character that differs from the previous state's text
+    long m_start = 0;
+    //! The text the previous state had at m_start
+    wxString m_removed;
+    //! The text this state has at m_start
+    wxString m_inserted;
+    int m_positionOfCaret = -1;
+    long m_selectionStart = -1;
+    long m_selectionEnd = -1;
+    //! The memory this step needs
+    size_t GetSize() const
+      { return sizeof(UndoStep) + (m_removed.Length() + m_inserted.Length()) * sizeof(wxChar); }
+  };
+
   wxString m_text;
-  wxArrayString m_textHistory;
-  std::vector<int> m_positionHistory;
-  std::vector<int> m_startHistory;
-  std::vector<int> m_endHistory;
-  //! Where in the undo history are we?
+  //! The undo history, the oldest state first
+  std::deque<UndoStep> m_history;
+  /*! The text of the state the undo history is at
+
+    The newest state in m_history or, after an Undo(), the state
+    m_historyPosition points to.
+   */
+  wxString m_historyText;
+  //! The memory m_history needs
+  size_t m_historyBytes = 0;
+  //! Where in the undo history are we? -1 = after the newest state
   ptrdiff_t m_historyPosition;
   //! Where inside this cell is the cursor?
   int m_positionOfCaret;
@@ -752,6 +808,37 @@ private:
   bool m_firstLineOnly;
   //! The individual commands, parenthesis, strings and whitespaces a code cell consists of
   MaximaTokenizer::TokenList m_tokens;
+  //! The text m_tokens was created from
+  wxString m_tokensText;
+  //! Was maxima in lisp mode when m_tokens was created?
+  bool m_tokensInLispMode;
+  //! Were asterisks to be displayed as dots when m_tokens was created?
+  bool m_tokensChangeAsterisk;
+  //! What the styled text of a code cell depends on except for its tokens
+  struct StyleKey
+  {
+    long m_lineWidth;
+    double m_fontSize;
+    TextStyle m_textStyle;
+    bool m_autoWrap;
+    bool m_autoAnswer;
+    bool m_firstLineOnly;
+    bool operator==(const StyleKey &key) const
+      {
+        return (m_lineWidth == key.m_lineWidth) && (m_fontSize == key.m_fontSize) &&
+          (m_textStyle == key.m_textStyle) && (m_autoWrap == key.m_autoWrap) &&
+          (m_autoAnswer == key.m_autoAnswer) && (m_firstLineOnly == key.m_firstLineOnly);
+      }
+  };
+  //! What m_styledText has been created for
+  StyleKey m_styledTextKey = {};
+  /*! The size m_styledText had after each of m_tokens had been styled
+
+    Allows StyleTextCode() to keep the styled text of the unchanged lines in
+    front of an edit. Is shorter than m_tokens if the styled text of the
+    remaining tokens is unknown.
+   */
+  std::vector<size_t> m_tokenStyledText;
 };
 
 #endif // EDITORCELL_H
@@ -174,8 +174,8 @@ void ExptCell::RecalculateHeight(int fontsize)
 
 wxString ExptCell::ToString()
 {
-  if (m_altCopyText != wxEmptyString)
-    return m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+    return GetAltCopyText();
   if (m_isBrokenIntoLines)
     return wxEmptyString;
   wxString s = m_baseCell->ListToString() + wxT("^");
@@ -190,8 +190,8 @@ wxString ExptCell::ToString()
 
 wxString ExptCell::ToMatlab()
 {
-  if (m_altCopyText != wxEmptyString)
-	return m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+	return GetAltCopyText();
   if (m_isBrokenIntoLines)
 	return wxEmptyString;
   wxString s = m_baseCell->ListToMatlab() + wxT("^");
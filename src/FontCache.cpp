@@ -222,6 +222,7 @@ bool equal_to<wxFontInfo>::operator()(const wxFontInfo &l, const wxFontInfo &r)
        )) &&
     l.GetFamily() == r.GetFamily() &&
     l.GetFaceName() == r.GetFaceName() &&
+    l.GetStyle() == r.GetStyle() &&
     l.GetWeight() == r.GetWeight() &&
     l.IsUnderlined() == r.IsUnderlined() &&
     l.IsStrikethrough() == r.IsStrikethrough() &&
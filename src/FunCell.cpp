@@ -135,8 +135,8 @@ wxString FunCell::ToString()
 {
   if (m_isBrokenIntoLines)
     return wxEmptyString;
-  if (m_altCopyText != wxEmptyString)
-    return m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+    return GetAltCopyText();
   return m_nameCell->ListToString() + m_argCell->ListToString();
 }
 
@@ -144,8 +144,8 @@ wxString FunCell::ToMatlab()
 {
   if (m_isBrokenIntoLines)
 	return wxEmptyString;
-  if (m_altCopyText != wxEmptyString)
-	return m_altCopyText + Cell::ListToMatlab();
+  if (GetAltCopyText() != wxEmptyString)
+	return GetAltCopyText() + Cell::ListToMatlab();
   wxString s = m_nameCell->ListToMatlab() + m_argCell->ListToMatlab();
   return s;
 }
@@ -0,0 +1,106 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+
+  This file defines the class FuzzyWordIndex that finds words that are spelled
+  similar to a given word.
+ */
+
+#include "FuzzyWordIndex.h"
+#include "levenshtein/levenshtein.h"
+#include <cstdlib>
+
+void FuzzyWordIndex::Add(const wxString &word)
+{
+  if (!m_words.insert(word).second)
+    return;
+
+  if (m_nodes.empty())
+  {
+    m_nodes.emplace_back(word);
+    return;
+  }
+
+  size_t node = 0;
+  while (true)
+  {
+    int distance = LevenshteinDistance(word, m_nodes[node].m_word);
+    size_t child = 0;
+    for (auto const &i : m_nodes[node].m_children)
+      if (i.first == distance)
+      {
+        child = i.second;
+        break;
+      }
+    if (child == 0)
+    {
+      m_nodes[node].m_children.emplace_back(distance, m_nodes.size());
+      m_nodes.emplace_back(word);
+      return;
+    }
+    node = child;
+  }
+}
+
+void FuzzyWordIndex::Clear()
+{
+  m_nodes.clear();
+  m_words.clear();
+}
+
+void FuzzyWordIndex::FindSimilar(const wxString &word, int maxDistance,
+                                 std::vector<wxArrayString> &result) const
+{
+  result.clear();
+  if (maxDistance < 1)
+    return;
+  result.resize(maxDistance);
+  if (m_nodes.empty())
+    return;
+
+  std::vector<size_t> nodesToVisit;
+  nodesToVisit.push_back(0);
+  while (!nodesToVisit.empty())
+  {
+    const Node &node = m_nodes[nodesToVisit.back()];
+    nodesToVisit.pop_back();
+
+    int distance = LevenshteinDistance(word, node.m_word);
+    if ((distance > 0) && (distance <= maxDistance))
+      result[distance - 1].Add(node.m_word);
+
+    for (auto const &child : node.m_children)
+      if (std::abs(child.first - distance) <= maxDistance)
+        nodesToVisit.push_back(child.second);
+  }
+
+  for (auto &words : result)
+    words.Sort();
+}
+
+void FuzzyWordIndex::FindWithPrefix(const wxString &prefix, wxArrayString &result) const
+{
+  for (auto it = m_words.lower_bound(prefix);
+       (it != m_words.end()) && it->StartsWith(prefix); ++it)
+    result.Add(*it);
+}
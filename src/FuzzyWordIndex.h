@@ -0,0 +1,90 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+
+  This file declares the class FuzzyWordIndex that finds words that are spelled
+  similar to a given word.
+ */
+
+#ifndef FUZZYWORDINDEX_H
+#define FUZZYWORDINDEX_H
+
+#include <wx/string.h>
+#include <wx/arrstr.h>
+#include <set>
+#include <vector>
+
+/*! An index that finds all words that are spelled similar to a word
+
+  The words are stored in a BK-tree: Every child of a node remembers its
+  Levenshtein distance to the node. As the Levenshtein distance fulfills
+  the triangle inequality all words that differ from a word by at most n edits
+  can be found in the children whose distance to the node differs from the
+  distance between the node and the word by at most n. This means that a search
+  only has to calculate the distance to a small part of the words.
+
+  Additionally the words are kept in a sorted list so the words that start with
+  a given prefix can be found, too.
+*/
+class FuzzyWordIndex
+{
+public:
+  //! Adds a word to the index, if it isn't in the index already
+  void Add(const wxString &word);
+  //! Removes all words from the index
+  void Clear();
+  //! Is the index empty?
+  bool IsEmpty() const { return m_nodes.empty(); }
+  //! The number of words in the index
+  size_t GetCount() const { return m_nodes.size(); }
+  //! Does the index contain this exact word?
+  bool Contains(const wxString &word) const { return m_words.find(word) != m_words.end(); }
+
+  /*! Finds all words that differ from word by 1 to maxDistance edits
+
+    \param word The word to search similar words to
+    \param maxDistance The maximum Levenshtein distance a word may have to word
+    \param result Receives the words: result[n-1] contains the words that
+    are n edits away from word, sorted alphabetically.
+  */
+  void FindSimilar(const wxString &word, int maxDistance, std::vector<wxArrayString> &result) const;
+
+  //! Appends all words that start with prefix to result, sorted alphabetically
+  void FindWithPrefix(const wxString &prefix, wxArrayString &result) const;
+
+private:
+  //! A word in the BK-tree
+  struct Node
+  {
+    explicit Node(const wxString &word) : m_word(word) {}
+    wxString m_word;
+    //! The children of this node: Their distance to m_word and their index in m_nodes
+    std::vector<std::pair<int, size_t>> m_children;
+  };
+  //! All nodes of the BK-tree. The first one is the root.
+  std::vector<Node> m_nodes;
+  //! All words in alphabetical order
+  std::set<wxString> m_words;
+};
+
+#endif // FUZZYWORDINDEX_H
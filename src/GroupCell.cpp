@@ -38,6 +38,7 @@
 #include "ImgCell.h"
 #include "BitmapOut.h"
 #include "list"
+#include <unordered_map>
 
 GroupCell::GroupCell(Configuration **config, GroupType groupType, CellPointers *cellPointers, const wxString &initString) :
   Cell(this, config, cellPointers)
@@ -48,6 +49,7 @@ GroupCell::GroupCell(Configuration **config, GroupType groupType, CellPointers *
   m_cellsInGroup = 1;
   m_inEvaluationQueue = false;
   m_lastInEvaluationQueue = false;
+  m_sizeIsEstimated = false;
   m_labelWidth_cached = 0;
   m_hiddenTree = NULL;
   m_hiddenTreeParent = NULL;
@@ -145,7 +147,7 @@ GroupCell::GroupCell(Configuration **config, GroupType groupType, CellPointers *
   // it loads an image (without deleting it)
   if ((groupType == GC_TYPE_IMAGE) && (initString.Length() > 0))
   {
-    std::shared_ptr <wxFileSystem> noFS;
+    std::shared_ptr<ZipArchive> noFS;
     Cell *ic;
     if(wxImage::GetImageCount(initString) < 2)
       ic = new ImgCell(this, m_configuration, m_cellPointers, initString, noFS, false);
@@ -324,6 +326,7 @@ void GroupCell::MarkAsDeleted()
     m_cellPointers->m_lastWorkingGroup = NULL;
   if (this == m_cellPointers->m_groupCellUnderPointer)
     m_cellPointers->m_groupCellUnderPointer = NULL;
+  m_cellPointers->m_groupCellIndex.Invalidate();
 
   Cell::MarkAsDeleted();
 }
@@ -377,6 +380,7 @@ void GroupCell::SetOutput(Cell *output)
   m_output = std::shared_ptr<Cell>(output);
 
   m_lastInOutput = m_output.get();
+  m_outputLayout.m_lastCell = NULL;
 
   m_outputHeight = -1;
   if(m_output != NULL)
@@ -404,7 +408,11 @@ void GroupCell::RemoveOutput()
     m_cellPointers->m_answerCell = NULL;
 
   if (GetGroupType() != GC_TYPE_IMAGE)
+  {
     m_output = NULL;
+    m_lastInOutput = NULL;
+  }
+  m_outputLayout.m_lastCell = NULL;
 
   m_cellPointers->m_errorList.Remove(this);
   // Calculate the new cell height.
@@ -430,7 +438,7 @@ void GroupCell::RemoveOutput()
   UpdateConfusableCharWarnings();
 }
 
-void GroupCell::AppendOutput(Cell *cell)
+void GroupCell::AppendOutput(Cell *cell, bool updateNow)
 {
   wxASSERT_MSG(cell != NULL, _("Bug: Trying to append NULL to a group cell."));
   if (cell == NULL) return;
@@ -443,102 +451,219 @@ void GroupCell::AppendOutput(Cell *cell)
       (dynamic_cast<EditorCell *>(m_inputLabel->m_next))->ContainsChanges(false);
 
     m_lastInOutput = m_output.get();
+    m_cellsInGroup = 2;
+  }
 
+  else
+  {
+    if (m_lastInOutput == NULL)
+      m_lastInOutput = m_output.get();
+
+    // Normally m_lastInOutput already is the end of the output.
     while (m_lastInOutput->m_next != NULL)
       m_lastInOutput = m_lastInOutput->m_next;
-  }
 
-  else
+    m_lastInOutput->AppendCell(cell);
+  }
+  // Only the cells we just have appended need to be searched for the new end
+  // of the output.
+  while (m_lastInOutput->m_next != NULL)
+    m_lastInOutput = m_lastInOutput->m_next;
+  // Only the cells we just have appended need to be counted. Doing so before
+  // they are laid out lets RecalculateAppended() know if the output has grown
+  // too big for a 2D layout.
+  m_cellsInGroup += cell->CellsInListRecursive();
+  // Searching only them for lookalike chars keeps streaming long output linear.
+  AddConfusableCharWarnings(cell->VariablesAndFunctionsList());
+  m_outputHeight = -1;
+  // If we know where the layout of the old output has ended RecalculateAppended()
+  // can lay out the new cells without touching the old ones.
+  if (m_outputLayout.m_lastCell == NULL)
   {
-    Cell *tmp = m_lastInOutput;
-    if (tmp == NULL)
-      tmp = m_output.get();
+    m_output->ResetSize();
+    ResetSize();
+    ResetData();
+  }
+  if (updateNow)
+    OutputAppended();
+}
 
-    while (tmp->m_next != NULL)
-      tmp = tmp->m_next;
+void GroupCell::OutputAppended()
+{
+  if (!RecalculateAppended())
+  {
+    if (m_output != NULL)
+      m_output->ResetSize();
+    ResetSize();
+    ResetData();
+    GroupCell::Recalculate();
+  }
+}
 
-    tmp->AppendCell(cell);
+wxString GroupCell::LookalikeSkeleton(const wxString &word)
+{
+  //! Maps each lookalike char to the char with the lowest code that looks alike
+  static const std::unordered_map<wxChar, wxChar> skeletonChars = []{
+    std::unordered_map<wxChar, wxChar> parent;
+    auto find = [&parent](wxChar ch) {
+      while(parent[ch] != ch)
+        ch = parent[ch];
+      return ch;
+    };
+    for (wxString::const_iterator it = m_lookalikeChars.begin(); it < m_lookalikeChars.end(); ++it)
+    {
+      wxChar ch1 = *it;
+      ++it;
+      wxASSERT(it < m_lookalikeChars.end());
+      wxChar ch2 = *it;
+      if(parent.find(ch1) == parent.end())
+        parent[ch1] = ch1;
+      if(parent.find(ch2) == parent.end())
+        parent[ch2] = ch2;
+      ch1 = find(ch1);
+      ch2 = find(ch2);
+      if(ch1 < ch2)
+        parent[ch2] = ch1;
+      else
+        parent[ch1] = ch2;
+    }
+    std::unordered_map<wxChar, wxChar> skeleton;
+    for (auto const &ch : parent)
+      skeleton[ch.first] = find(ch.first);
+    return skeleton;
+  }();
 
-    if(m_lastInOutput != NULL)
-      while (m_lastInOutput->m_next != NULL)
-        m_lastInOutput = m_lastInOutput->m_next;
+  wxString skeleton;
+  skeleton.reserve(word.Length());
+  for (wxString::const_iterator it = word.begin(); it != word.end(); ++it)
+  {
+    wxChar ch = *it;
+    auto skeletonChar = skeletonChars.find(ch);
+    if(skeletonChar != skeletonChars.end())
+      ch = skeletonChar->second;
+    skeleton += ch;
   }
-  m_output->ResetSize();
-  m_output->ResetSize();
-  m_outputHeight = -1;
-  ResetSize();
-  ResetData();
-  GroupCell::Recalculate();
-  UpdateCellsInGroup();
-  UpdateConfusableCharWarnings();
+  return skeleton;
 }
 
 void GroupCell::UpdateConfusableCharWarnings()
 {
-  ClearToolTip();
-
-  wxString code;
+  wxString input;
   if(GetInput())
-    code += GetInput()->ListToString() + " ";
+    input = GetInput()->GetValue();
+  wxString output;
   if(GetOutput())
-    code += GetOutput()->VariablesAndFunctionsList();
+    output = GetOutput()->VariablesAndFunctionsList();
+
+  // Nothing to do if the warnings have been created for the same text
+  if((input == m_confusableCharsInput) && (output == m_confusableCharsOutput))
+    return;
+  m_confusableCharsInput = input;
+  m_confusableCharsOutput = output;
+
+  ClearToolTip();
+  m_confusableWordsBySkeleton.clear();
+
   // Extract all variable and command names from the cell including input and output
-  CmdsAndVariables cmdsAndVariables;
+  wxString code = output;
+  // The input of code cells has already been tokenized - but only up to the
+  // hidden lines placeholder, if the cell is folded.
+  if(GetInput() && (m_groupType == GC_TYPE_CODE) && !GetInput()->IsFirstLineOnly())
+  {
+    for (auto const &word : GetInput()->GetWordList())
+      AddConfusableCharWord(word);
+  }
+  else
+    code = input + " " + code;
+  AddConfusableCharWords(code);
+}
+
+void GroupCell::AddConfusableCharWarnings(const wxString &outputNames)
+{
+  if(outputNames.IsEmpty())
+    return;
+
+  wxString input;
+  if(GetInput())
+    input = GetInput()->GetValue();
+  if(input != m_confusableCharsInput)
+  {
+    UpdateConfusableCharWarnings();
+    return;
+  }
+
+  m_confusableCharsOutput += outputNames;
+  AddConfusableCharWords(outputNames);
+}
 
+void GroupCell::AddConfusableCharWords(const wxString &code)
+{
   for (auto const &tok : MaximaTokenizer(code, *m_configuration).PopTokens())
     if((tok.GetStyle() == TS_CODE_VARIABLE) || (tok.GetStyle() == TS_CODE_FUNCTION))
-      cmdsAndVariables[tok.GetText()] = 1;
-  
-  // Now we step through all the words we found
-  while(!cmdsAndVariables.empty())
-  {
-    CmdsAndVariables::iterator cmp = cmdsAndVariables.begin();
-    wxString word;
-    word = cmp->first;
-    cmdsAndVariables.erase(cmp);
-    // Now iterate through all remaining words
-    cmp = cmdsAndVariables.begin();
-    while(cmp != cmdsAndVariables.end())
-    {
-      // iterate through all lookalike chars
-      for (wxString::const_iterator it = m_lookalikeChars.begin(); it < m_lookalikeChars.end(); ++it)
-      {
-        wxChar ch1 = *it;
-        ++it;
-        wxASSERT(it < m_lookalikeChars.end());
-        wxChar ch2 = *it;
-        wxString word_subst = word;
-        if(word_subst.Replace(ch1,ch2))
-        {
-          if(cmp->first == word_subst)
-            AddToolTip(_("Warning: Lookalike chars: ") +
-                       cmp->first.utf8_str() + wxT("\u2260") +
-                       word.utf8_str()
-              );
-        }
-        word_subst = word;
-        if(word_subst.Replace(ch2,ch1))
-        {
-          if(cmp->first == word_subst)
-            AddToolTip(_("Warning: Lookalike chars: ") +
-                       cmp->first +
-                       wxT(" \u2260 ") +
-                       word
-              );
-        }
-          
-      }
-      ++cmp;
-    }
-  }
+      AddConfusableCharWord(tok.GetText());
+}
+
+void GroupCell::AddConfusableCharWord(const wxString &word)
+{
+  // Words that look alike have the same skeleton
+  wxArrayString &lookalikes = m_confusableWordsBySkeleton[LookalikeSkeleton(word)];
+  if(lookalikes.Index(word) != wxNOT_FOUND)
+    return;
+
+  for (auto const &lookalike : lookalikes)
+    AddToolTip(_("Warning: Lookalike chars: ") +
+               lookalike +
+               wxT(" \u2260 ") +
+               word
+      );
+  lookalikes.Add(word);
 }
 
 void GroupCell::Recalculate()
 {
+  // A cell whose size was only estimated might have missed a forced recalculation
+  // of the worksheet => force recalculating all of its contents.
+  bool recalculationForce = (*m_configuration)->RecalculationForce();
+  if(m_sizeIsEstimated)
+  {
+    (*m_configuration)->RecalculationForce(true);
+    m_sizeIsEstimated = false;
+  }
   m_fontSize = (*m_configuration)->GetDefaultFontSize();
   m_mathFontSize = (*m_configuration)->GetMathFontSize();
   GroupCell::RecalculateWidths((*m_configuration)->GetDefaultFontSize());
   GroupCell::RecalculateHeight((*m_configuration)->GetDefaultFontSize());
+  (*m_configuration)->RecalculationForce(recalculationForce);
+  m_cellPointers->m_groupCellIndex.LayoutUpdated(this);
+}
+
+void GroupCell::EstimateSize()
+{
+  if(!m_sizeIsEstimated && NeedsRecalculation((*m_configuration)->GetDefaultFontSize()))
+  {
+    m_sizeIsEstimated = true;
+    // If we never knew the cell's size we guess it from the number of lines it contains.
+    if((m_width < 0) || (m_height < 0) || (m_center < 0))
+    {
+      int lineHeight = Scale_Px(1.5 * (*m_configuration)->GetDefaultFontSize());
+      int lines = 1;
+      if(GetEditable() != NULL)
+        lines += GetEditable()->GetValue().Freq(wxT('\n'));
+      if(!m_isHidden)
+      {
+        for(Cell *tmp = m_output.get(); tmp != NULL; tmp = tmp->m_next)
+          if(tmp->BreakLineHere())
+            lines++;
+      }
+      m_width = wxMax(m_width, 0);
+      m_center = lineHeight / 2;
+      m_height = lines * lineHeight;
+      (*m_configuration)->AdjustWorksheetSize(true);
+    }
+    m_maxCenter = -1;
+    m_maxDrop = -1;
+  }
+  UpdateYPosition();
 }
 
 void GroupCell::RecalculateWidths(int fontsize)
@@ -618,6 +743,7 @@ void GroupCell::InputHeightChanged()
 // breakup cells and compute new line breaks
 void GroupCell::OnSize()
 {
+  m_outputLayout.m_lastCell = NULL;
   // Unbreakup cells
   Cell *tmp = m_output.get();
   while (tmp != NULL)
@@ -722,6 +848,7 @@ void GroupCell::RecalculateHeightInput()
 
 void GroupCell::RecalculateHeightOutput()
 {
+  m_outputLayout.m_lastCell = NULL;
   if(m_isHidden)
     return;
 
@@ -767,14 +894,40 @@ void GroupCell::RecalculateHeightOutput()
   }
 
   // Update heights
-  tmp = m_output.get();
-  tmp->ForceBreakLine(true);
-  while (tmp != NULL)
+  m_output->ForceBreakLine(true);
+  m_outputLayout.m_width = 0;
+  AddOutputLineHeights(m_output.get());
+
+  // Remember where we are, so the next output that is appended can be laid out
+  // starting from here.
+  m_outputLayout.m_lastCell = m_lastInOutput;
+  m_outputLayout.m_clientWidth = configuration->GetClientWidth();
+  m_outputLayout.m_zoomFactor = configuration->GetZoomFactor();
+  m_outputLayout.m_fontSize = configuration->GetDefaultFontSize();
+  m_outputLayout.m_mathFontSize = configuration->GetMathFontSize();
+  m_outputLayout.m_breaksUpAllCells = BreaksUpAllCells();
+
+  ResetData();
+  
+  // Move all cells that follow the current one down by the amount this cell has grown.
+  GroupCell *cell = this;
+  while(cell != NULL)
+    cell = cell->UpdateYPosition();
+  (*m_configuration)->AdjustWorksheetSize(true);
+}
+
+void GroupCell::AddOutputLineHeights(Cell *lineStart)
+{
+  Configuration *configuration = (*m_configuration);
+  for (Cell *tmp = lineStart; tmp != NULL; tmp = tmp->GetNextToDraw())
   {
     if (tmp->BreakLineHere())
     {
+      m_outputLayout.m_lastLineStart = tmp;
+      m_outputLayout.m_heightBeforeLastLine = m_outputRect.height;
       int height_Delta = tmp->GetHeightList();
-      m_width = wxMax(m_width, tmp->GetLineWidth());
+      m_outputLayout.m_width = wxMax(m_outputLayout.m_width, tmp->GetLineWidth());
+      m_width = wxMax(m_width, m_outputLayout.m_width);
       m_height            += height_Delta;
       m_outputRect.width = m_width;
       m_outputRect.height += height_Delta;
@@ -792,16 +945,72 @@ void GroupCell::RecalculateHeightOutput()
         m_outputRect.height += MC_LINE_SKIP;
       }
     }
-    tmp = tmp->GetNextToDraw();
   }
+}
+
+bool GroupCell::RecalculateAppended()
+{
+  Configuration *configuration = (*m_configuration);
+  Cell *lastCell = m_outputLayout.m_lastCell;
+  if ((lastCell == NULL) || (lastCell->m_next == NULL) ||
+      (m_outputLayout.m_lastLineStart == NULL) ||
+      m_isHidden || m_sizeIsEstimated ||
+      (m_width < 0) || (m_height < 0) || (m_center < 0) ||
+      (m_outputLayout.m_clientWidth != configuration->GetClientWidth()) ||
+      (m_outputLayout.m_zoomFactor != configuration->GetZoomFactor()) ||
+      (m_outputLayout.m_fontSize != configuration->GetDefaultFontSize()) ||
+      (m_outputLayout.m_mathFontSize != configuration->GetMathFontSize()) ||
+      (m_outputLayout.m_breaksUpAllCells != BreaksUpAllCells()) ||
+      configuration->RecalculationForce() || configuration->FontChanged())
+    return false;
+
+  Cell *appended = lastCell->m_next;
+
+  // Recalculate widths of the new cells
+  for (Cell *tmp = appended; tmp != NULL; tmp = tmp->m_next)
+    tmp->RecalculateWidths(tmp->IsMath() ?
+                           configuration->GetMathFontSize() :
+                           configuration->GetDefaultFontSize());
+
+  // Breakup the new cells that are too wide
+  if (BreakUpCells(appended))
+  {
+    appended->ResetSizeList();
+    appended->RecalculateList(configuration->GetMathFontSize());
+  }
+
+  // The new cells might make the last old line wider or higher
+  for (Cell *tmp = m_outputLayout.m_lastLineStart;
+       (tmp != NULL) && (tmp != appended);
+       tmp = tmp->GetNextToDraw())
+    tmp->ResetData();
+
+  // Break the new cells into lines, continuing the last old line
+  m_outputLayout.m_lastLineWidth = BreakLinesFrom(appended, m_outputLayout.m_lastLineWidth);
+
+  // Recalculate size of the new cells
+  for (Cell *tmp = appended; tmp != NULL; tmp = tmp->m_next)
+  {
+    tmp->RecalculateHeight(tmp->IsMath() ?
+                           configuration->GetMathFontSize() :
+                           configuration->GetDefaultFontSize());
+    tmp->ResetData();
+  }
+
+  // Update heights, starting with the last line that has been laid out before
+  m_outputRect.height = m_outputLayout.m_heightBeforeLastLine;
+  m_height = m_inputHeight + m_outputRect.height;
+  AddOutputLineHeights(m_outputLayout.m_lastLineStart);
+  m_outputLayout.m_lastCell = m_lastInOutput;
 
   ResetData();
-  
+
   // Move all cells that follow the current one down by the amount this cell has grown.
   GroupCell *cell = this;
   while(cell != NULL)
     cell = cell->UpdateYPosition();
-  (*m_configuration)->AdjustWorksheetSize(true);
+  configuration->AdjustWorksheetSize(true);
+  return true;
 }
 
 bool GroupCell::NeedsRecalculation(int fontSize)
@@ -851,6 +1060,7 @@ GroupCell *GroupCell::UpdateYPosition()
     else
       m_currentPoint.y = dynamic_cast<GroupCell *>(m_previous)->m_currentPoint.y;
   }
+  m_cellPointers->m_groupCellIndex.LayoutUpdated(this);
   return GetNext();
 }
 
@@ -1840,7 +2050,7 @@ wxString GroupCell::GetToolTip(const wxPoint &point)
     m_cellPointers->m_cellUnderPointer = this;
   }
   
-  wxString retval = m_toolTip;
+  wxString retval = GetLocalToolTip();
 
   if (m_isHidden)
     return retval;
@@ -1899,6 +2109,7 @@ void GroupCell::BreakLines()
 
 void GroupCell::BreakLines(Cell *cell)
 {
+  m_outputLayout.m_lastCell = NULL;
   if(cell == NULL)
     return;
 
@@ -1913,10 +2124,18 @@ void GroupCell::BreakLines(Cell *cell)
     ResetData();
   }
 
+  m_outputLayout.m_lastLineWidth = BreakLinesFrom(cell, GetLineIndent(cell));
+}
+
+int GroupCell::BreakLinesFrom(Cell *cell, int currentWidth)
+{
   int fullWidth = (*m_configuration)->GetClientWidth();
   Configuration *configuration = (*m_configuration);
-  int currentWidth = GetLineIndent(cell);
-  if((cell->GetStyle() != TS_LABEL) && (cell->GetStyle() != TS_USERLABEL))
+  // The width available for the output depends on how it starts
+  Cell *first = m_output.get();
+  if(first == NULL)
+    first = cell;
+  if((first->GetStyle() != TS_LABEL) && (first->GetStyle() != TS_USERLABEL))
     fullWidth -= configuration->GetIndent();
 
   // Don't let the layout degenerate for small window widths
@@ -1941,6 +2160,7 @@ void GroupCell::BreakLines(Cell *cell)
     }
     cell = cell->GetNextToDraw();
   }
+  return currentWidth;
 }
 
 void GroupCell::SelectOutput(Cell **start, Cell **end)
@@ -1967,13 +2187,8 @@ void GroupCell::SelectOutput(Cell **start, Cell **end)
     *end = *start = NULL;
 }
 
-bool GroupCell::BreakUpCells(Cell *cell)
+bool GroupCell::BreaksUpAllCells()
 {
-  bool lineHeightsChanged = false;
-
-  if(cell == NULL)
-    return false;
-
   int showLength;
   switch ((*m_configuration)->ShowLength())
   {
@@ -1992,9 +2207,18 @@ bool GroupCell::BreakUpCells(Cell *cell)
   default:
     showLength = 500;    
   }
+  return m_cellsInGroup > showLength;
+}
+
+bool GroupCell::BreakUpCells(Cell *cell)
+{
+  bool lineHeightsChanged = false;
+
+  if(cell == NULL)
+    return false;
 
   // Reduce the number of steps involved in layouting big equations
-  if(m_cellsInGroup > showLength)
+  if(BreaksUpAllCells())
   {
     wxLogMessage(_("Resolving to 1D layout for one cell in order to save time"));
     while (cell != NULL && !m_isHidden)
@@ -2073,6 +2297,7 @@ void GroupCell::Hide(bool hide)
     return;
 
   m_isHidden = hide;
+  m_outputLayout.m_lastCell = NULL;
   if ((m_groupType == GC_TYPE_TEXT) || (m_groupType == GC_TYPE_CODE))
     GetEditable()->SetFirstLineOnly(m_isHidden);
 
@@ -2494,7 +2719,6 @@ wxString GroupCell:: m_lookalikeChars(
     wxT("A")		wxT("\u0391")
     wxT("A")		wxT("\u0410")
     wxT("\u0391")	wxT("\u0410")
-    wxT("M")		wxT("\u0392")
     wxT("E")		wxT("\u0395")
     wxT("E")		wxT("\u0415")
     wxT("\u0415")	wxT("\u0395")
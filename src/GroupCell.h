@@ -32,6 +32,7 @@
 
 #include "Cell.h"
 #include "EditorCell.h"
+#include <unordered_map>
 
 #define EMPTY_INPUT_LABEL wxT(" -->  ")
 
@@ -169,7 +170,15 @@ public:
   bool SetEditableContent(wxString text);
 
   EditorCell *GetEditable() const; // returns pointer to editor (if there is one)
-  void AppendOutput(Cell *cell);
+  /*! Add a list of cells to the output of this GroupCell
+
+    \param updateNow false means: Leave laying out the output and updating the
+    information that depends on it to a later call to OutputAppended(). Allows
+    to append many lines of output at the cost of laying it out once.
+   */
+  void AppendOutput(Cell *cell, bool updateNow = true);
+  //! Lays out the output that has been added by AppendOutput(cell, false)
+  void OutputAppended();
 
   /*! Remove all output cells attached to this one
 
@@ -179,8 +188,19 @@ public:
   */
   void RemoveOutput();
 
-  //! GroupCells warn if they contain both greek and latin lookalike chars.
+  /*! GroupCells warn if they contain both greek and latin lookalike chars.
+
+    Does nothing if neither the input nor the output has changed since the
+    last call.
+  */
   void UpdateConfusableCharWarnings();
+
+  /*! Extends the lookalike char warnings by the names in newly appended output
+
+    Only tokenizes outputNames, so appending many lines of output doesn't
+    re-scan the whole output for each line.
+  */
+  void AddConfusableCharWarnings(const wxString &outputNames);
   
   wxString ToTeX(wxString imgDir, wxString filename, int *imgCounter);
 
@@ -261,6 +281,17 @@ public:
    */
   void RecalculateHeightOutput();
 
+  /*! Lays out only the output cells that have been appended since the last layout
+
+    Continues the layout where the last line of the output that has been laid out
+    ended instead of starting again from the beginning of the output.
+
+    \retval false, if the output needs to be laid out from the start, instead, for
+    example since the width of the worksheet, the zoom factor or the fonts have
+    changed since the last layout.
+   */
+  bool RecalculateAppended();
+
   /*! Recalculates the width of this GroupCell and all cells inside it if needed.
    */
   void RecalculateWidths(int fontsize) override;
@@ -271,6 +302,18 @@ public:
   */
   void Recalculate();
 
+  /*! Guess the size of this GroupCell instead of recalculating it.
+
+    Used for cells that are far outside the visible part of the worksheet: It
+    keeps the last known size if there is one and else guesses the size from the
+    number of lines the cell contains. Cells whose size is up-to-date keep it.
+    The cell's y position is updated in both cases.
+  */
+  void EstimateSize();
+
+  //! Is the size of this cell only a guess that still needs to be replaced by Recalculate()?
+  bool SizeIsEstimated() const {return m_sizeIsEstimated;}
+
   /*! Attempt to split math objects that are wider than the screen into multiple lines.
     
     \retval true, if this action has changed the height of cells.
@@ -286,6 +329,14 @@ public:
   //! Break this cell into lines
   void BreakLines(Cell *cell);
 
+  /*! Break the output into lines, starting with cell
+
+    \param cell The first cell that is to be assigned a line
+    \param currentWidth The width of the line cell is appended to
+    \return The width of the last line
+   */
+  int BreakLinesFrom(Cell *cell, int currentWidth);
+
   /*! Reset the input label of the current cell.
 
     Won't do nothing if the cell isn't a code cell and therefore isn't equipped
@@ -497,6 +548,14 @@ protected:
   bool NeedsRecalculation(int fontSize) override;
   int GetInputIndent();
   int GetLineIndent(Cell *cell);
+  //! Do we need to break up all cells in order to lay out this cell in a reasonable time?
+  bool BreaksUpAllCells();
+  /*! Add the heights of the lines of the output, starting with lineStart
+
+    Updates m_width, m_height and m_outputRect and remembers where the last
+    line starts in m_outputLayout.
+   */
+  void AddOutputLineHeights(Cell *lineStart);
   GroupCell *m_hiddenTree; //!< here hidden (folded) tree of GCs is stored
   GroupCell *m_hiddenTreeParent; //!< store linkage to the parent of the fold
   //! Which type this cell is of?
@@ -510,13 +569,47 @@ protected:
   int m_mathFontSize;
   Cell *m_lastInOutput;
   static wxString m_lookalikeChars;
+  //! Replaces every char in word by the char with the lowest code that looks alike
+  static wxString LookalikeSkeleton(const wxString &word);
 private:
+  //! The input UpdateConfusableCharWarnings() has created the warnings for
+  wxString m_confusableCharsInput;
+  //! The output names UpdateConfusableCharWarnings() has created the warnings for
+  wxString m_confusableCharsOutput;
+  //! The names in this cell, grouped by their lookalike skeleton
+  std::unordered_map<wxString, wxArrayString, wxStringHash, wxStringEqual> m_confusableWordsBySkeleton;
+  //! Adds the variable and function names in code to the lookalike char check
+  void AddConfusableCharWords(const wxString &code);
+  //! Adds word to the lookalike char check, warning about earlier lookalikes
+  void AddConfusableCharWord(const wxString &word);
   Cell *m_nextToDraw;
   //! Does this GroupCell automatically fill in the answer to questions?
   bool m_autoAnswer;
   wxRect m_outputRect;
   bool m_inEvaluationQueue;
   bool m_lastInEvaluationQueue;
+  //! Is the size of this cell only a guess by EstimateSize()?
+  bool m_sizeIsEstimated;
+  //! Where the last layout of the output ended, so RecalculateAppended() can continue there
+  struct OutputLayout
+  {
+    //! The last cell of m_output that has been laid out, NULL = start from the beginning
+    Cell *m_lastCell = NULL;
+    //! The cell the last line of the output starts with
+    Cell *m_lastLineStart = NULL;
+    //! The width of the last line of the output
+    int m_lastLineWidth = 0;
+    //! The height of all lines of the output but the last one
+    int m_heightBeforeLastLine = 0;
+    //! The width of the widest line of the output
+    int m_width = 0;
+    //! The width of the worksheet the output has been laid out for
+    int m_clientWidth = -1;
+    double m_zoomFactor = -1;
+    int m_fontSize = -1;
+    int m_mathFontSize = -1;
+    bool m_breaksUpAllCells = false;
+  } m_outputLayout;
   int m_inputWidth, m_inputHeight, m_outputWidth, m_outputHeight;
   //! The number of cells the current group contains (-1, if no GroupCell)
   int m_cellsInGroup;
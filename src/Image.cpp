@@ -33,7 +33,9 @@
 #include <wx/txtstrm.h>
 #include <wx/regex.h>
 #include <wx/stdpaths.h>
+#include <wx/app.h>
 #include "SvgBitmap.h"
+#include "BitmapCache.h"
 #include "ErrorRedirector.h"
 
 Image::Image(Configuration **config)
@@ -109,7 +111,7 @@ Image::Image(Configuration **config, const wxBitmap &bitmap)
 // filesystem cannot be passed by const reference as we want to keep the
 // pointer to the file system alive in a background task
 // cppcheck-suppress performance symbolName=filesystem
-Image::Image(Configuration **config, wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove):
+Image::Image(Configuration **config, wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove):
   m_fs_keepalive_imagedata(filesystem)
 {
   #ifdef HAVE_OMP_HEADER
@@ -135,6 +137,7 @@ Image::~Image()
   #ifdef HAVE_OPENMP_TASKS
   #pragma omp taskwait
   #endif
+  BitmapCache::Get().Remove(this);
   {
     if(!m_gnuplotSource.IsEmpty())
     {
@@ -179,6 +182,7 @@ wxBitmap Image::GetUnscaledBitmap()
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
   #endif
+  LoadDeferred();
 
   if(!m_isOk)
   {
@@ -210,6 +214,7 @@ wxMemoryBuffer Image::GetCompressedImage()
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
   #endif
+  LoadDeferred();
   return m_compressedImage;
 }
 
@@ -241,7 +246,7 @@ bool Image::IsOk()
 // filesystem cannot be passed by const reference as we want to keep the
 // pointer to the file system alive in a background task
 // cppcheck-suppress performance symbolName=filesystem
-void Image::GnuplotSource(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<wxFileSystem> filesystem)
+void Image::GnuplotSource(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<ZipArchive> filesystem)
 {
   m_fs_keepalive_gnuplotdata = filesystem;
   #ifdef HAVE_OPENMP_TASKS
@@ -251,7 +256,7 @@ void Image::GnuplotSource(wxString gnuplotFilename, wxString dataFilename, std::
   LoadGnuplotSource_Backgroundtask(gnuplotFilename, dataFilename, filesystem);
 }
 
-void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<wxFileSystem> filesystem)
+void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<ZipArchive> filesystem)
 {
   #ifdef HAVE_OMP_HEADER
   omp_set_lock(&m_gnuplotLock);
@@ -357,14 +362,9 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
   else
   {
     {
-      wxFSFile *fsfile;
-      #ifdef HAVE_OPENMP_TASKS
-      #pragma omp critical (OpenFSFile)
-      #endif
-      fsfile = filesystem->OpenFile(m_gnuplotSource);
-      if (fsfile)
+      std::unique_ptr<wxInputStream> input = filesystem->OpenEntry(m_gnuplotSource);
+      if (input)
       { // open successful
-        std::unique_ptr<wxInputStream> input(fsfile->GetStream());
         if(input->IsOk())
         {
           wxTextInputStream textIn(*input, wxT('\t'), wxConvAuto(wxFONTENCODING_UTF8));
@@ -411,14 +411,9 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
       }
     }
     {
-      wxFSFile *fsfile;
-      #ifdef HAVE_OPENMP_TASKS
-      #pragma omp critical (OpenFSFile)
-      #endif
-      fsfile = filesystem->OpenFile(m_gnuplotData);
-      if (fsfile)
+      std::unique_ptr<wxInputStream> input = filesystem->OpenEntry(m_gnuplotData);
+      if (input)
       { // open successful
-        wxInputStream *input = fsfile->GetStream();
         if(input->IsOk())
         {
           wxTextInputStream textIn(*input, wxT('\t'), wxConvAuto(wxFONTENCODING_UTF8));
@@ -672,6 +667,7 @@ wxSize Image::ToImageFile(wxString filename)
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
   #endif
+  LoadDeferred();
   wxFileName fn(filename);
   wxString ext = fn.GetExt();
   if (filename.Lower().EndsWith(GetExtension().Lower()))
@@ -750,65 +746,156 @@ wxBitmap Image::GetBitmap(double scale)
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
   #endif
+  LoadDeferred();
 
   if(!m_isOk)
   {
     InvalidBitmap();
     return m_scaledBitmap;    
   }
-  
+
+  // Make sure we stay within sane defaults
+  if (m_width < 1)m_width = 1;
+  if (m_height < 1)m_height = 1;
+
+  // Printing uses its own scale: The bitmaps printed aren't kept in the cache
+  // the screen uses.
+  bool printing = (*m_configuration)->GetPrinting();
+
   // Let's see if we have cached the scaled bitmap with the right size
-  if (m_scaledBitmap.GetWidth() == m_width)
-    return m_scaledBitmap;
+  wxBitmap bitmap;
+  if (!printing && BitmapCache::Get().Lookup(this, wxSize(m_width, m_height), bitmap))
+    return bitmap;
   
   // Seems like we need to create a new scaled bitmap.
+  wxImage img = CreateScaledImage(m_width, m_height);
+  if (!img.IsOk())
+  {
+    InvalidBitmap();
+    return m_scaledBitmap;
+  }
+  bitmap = wxBitmap(img);
+  if (!printing)
+    BitmapCache::Get().Add(this, bitmap);
+  return bitmap;
+}
+
+wxImage Image::CreateScaledImage(long width, long height)
+{
   if (m_svgRast)
   {
+    // m_svgRast holds the state of a rasterization in progress. A rasterizer
+    // of our own allows several images to be rasterized at once.
+    std::unique_ptr<struct NSVGrasterizer, decltype(nsvgDeleteRasterizer)*>
+      svgRast{nsvgCreateRasterizer(), nsvgDeleteRasterizer};
+    if (!svgRast)
+      return wxImage();
+
     // First create rgba data
-    std::vector<unsigned char> imgdata(m_width*m_height*4);
+    std::vector<unsigned char> imgdata(width*height*4);
 
-    nsvgRasterize(m_svgRast.get(), m_svgImage, 0,0,
-                  ((double)m_width)/((double)m_originalWidth),
-                  imgdata.data(), m_width, m_height, m_width*4);
-    #ifdef HAVE_OMP_HEADER
-    omp_unset_lock(&m_gnuplotLock);
-    #endif
-    return m_scaledBitmap = SvgBitmap::RGBA2wxBitmap(imgdata.data(), m_width, m_height);
+    nsvgRasterize(svgRast.get(), m_svgImage, 0,0,
+                  ((double)width)/((double)m_originalWidth),
+                  imgdata.data(), width, height, width*4);
+    return SvgBitmap::RGBA2wxImage(imgdata.data(), width, height);
   }
-  else
+
+  wxImage img;
+  if (m_compressedImage.GetDataLen() > 0)
   {
-    wxImage img;
-    if (m_compressedImage.GetDataLen() > 0)
-    {
-      wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+    wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+    img = wxImage(istream, wxBITMAP_TYPE_ANY);
+  }
+  if (img.IsOk())
+  {
+    img.Rescale(width, height, wxIMAGE_QUALITY_BICUBIC);
+    // Bitmaps are displayed without transparency
+    if (img.HasAlpha())
+      img.ClearAlpha();
+  }
+  return img;
+}
 
-      img = wxImage(istream, wxBITMAP_TYPE_ANY);
-    }
-    m_isOk = true;
+wxBitmap Image::GetBitmapOrPlaceholder(bool &ready)
+{
+  ready = true;
+  #ifdef HAVE_OPENMP_TASKS
+  if ((*m_configuration)->GetPrinting())
+    return GetBitmap();
 
-    if (img.Ok())
-      m_scaledBitmap = wxBitmap(img);
-    else
-      InvalidBitmap();
+  // Recalculate contains its own WaitForLoad object.
+  Recalculate();
+  // Rasterizing svg images and reading images that haven't been loaded from
+  // their .wxmx file yet are the slow cases.
+  bool slow;
+  {
+    #ifdef HAVE_OMP_HEADER
+    WaitForLoad waitforload(&m_imageLoadLock);
+    #endif
+    slow = m_isOk && (m_svgRast || m_loadDeferred);
+  }
+  if (!slow)
+    return GetBitmap();
+
+  wxSize size(wxMax(m_width, 1), wxMax(m_height, 1));
+  wxBitmap bitmap;
+  if (BitmapCache::Get().Lookup(this, size, bitmap))
+    return bitmap;
+  if (BitmapCache::Get().StartPrefetch(this, size))
+  {
+    #pragma omp task
+    PrefetchBitmap_Backgroundtask(size);
   }
+  if (BitmapCache::Get().IsBeingPrefetched(this, size, bitmap))
+  {
+    ready = false;
+    return bitmap;
+  }
+  #endif
+  // The background task has already finished - or has failed.
+  return GetBitmap();
+}
 
-  // Make sure we stay within sane defaults
-  if (m_width < 1)m_width = 1;
-  if (m_height < 1)m_height = 1;
+void Image::PrefetchBitmap()
+{
+  // Without tasks prefetching would only delay the redraw.
+  #ifdef HAVE_OPENMP_TASKS
+  if (!m_isOk || (*m_configuration)->GetPrinting())
+    return;
+  wxSize size(wxMax(m_width, 1), wxMax(m_height, 1));
+  if (!BitmapCache::Get().StartPrefetch(this, size))
+    return;
+  #pragma omp task
+  PrefetchBitmap_Backgroundtask(size);
+  #endif
+}
 
-  // Create a scaled bitmap and return it.
-  if(m_scaledBitmap.IsOk())
+void Image::PrefetchBitmap_Backgroundtask(wxSize size)
+{
+  bool isOk;
   {
-    wxImage img = m_scaledBitmap.ConvertToImage();
-    img.Rescale(m_width, m_height, wxIMAGE_QUALITY_BICUBIC);
-    m_scaledBitmap = wxBitmap(img, 24);
+    // Wait until the image has been loaded. The loaded data isn't changed
+    // afterwards, which means we don't need to hold the lock while decoding:
+    // The GUI thread can still lay out the image in the meantime.
+    #ifdef HAVE_OMP_HEADER
+    WaitForLoad waitforload(&m_imageLoadLock);
+    #endif
+    LoadDeferred();
+    isOk = m_isOk;
   }
-  else
-    m_scaledBitmap = wxBitmap(1,1);
-  #ifdef HAVE_OMP_HEADER
-  omp_unset_lock(&m_gnuplotLock);
-  #endif
-  return m_scaledBitmap;
+  wxImage img;
+  if (isOk)
+    img = CreateScaledImage(size.x, size.y);
+  BitmapCache::Get().AddPrefetched(this, size, img);
+  // Let the idle loop redraw the cells that wait for this image.
+  wxWakeUpIdle();
+}
+
+void Image::ClearCache()
+{
+  if ((m_scaledBitmap.GetWidth() > 1) || (m_scaledBitmap.GetHeight() > 1))
+    m_scaledBitmap.Create(1, 1);
+  BitmapCache::Get().Remove(this);
 }
 
 void Image::InvalidBitmap()
@@ -844,6 +931,7 @@ void Image::LoadImage(const wxBitmap &bitmap)
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
   #endif
+  m_loadDeferred = false;
   // Convert the bitmap to a png image we can use as m_compressedImage
   wxImage image = bitmap.ConvertToImage();
   m_isOk = image.IsOk();
@@ -857,6 +945,7 @@ void Image::LoadImage(const wxBitmap &bitmap)
   m_originalWidth = image.GetWidth();
   m_originalHeight = image.GetHeight();
   m_scaledBitmap.Create(1, 1);
+  BitmapCache::Get().Remove(this);
   m_width = 1;
   m_height = 1;
 }
@@ -869,7 +958,7 @@ wxString Image::GetExtension()
 // filesystem cannot be passed by const reference as we want to keep the
 // pointer to the file system alive in a background task
 // cppcheck-suppress performance symbolName=filesystem
-void Image::LoadImage(wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove)
+void Image::LoadImage(wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove)
 {
   m_fs_keepalive_imagedata = filesystem;
   m_extension = wxFileName(image).GetExt();
@@ -887,7 +976,7 @@ void Image::LoadImage(wxString image, std::shared_ptr<wxFileSystem> filesystem,
   LoadImage_Backgroundtask(image, filesystem, remove);
 }
 
-void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove)
+void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove)
 {
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
@@ -896,25 +985,142 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
   m_imageName = image;
   m_compressedImage.Clear();
   m_scaledBitmap.Create(1, 1);
+  BitmapCache::Get().Remove(this);
+  m_loadDeferred = false;
 
-  if (filesystem)
+  ReadImageData(image, filesystem, remove);
+  // The image data has been copied: No need to keep the .wxmx file mapped,
+  // which would keep it from being replaced when the worksheet is saved.
+  m_fs_keepalive_imagedata.reset();
+
+  // Opening a .wxmx file shouldn't need to decode every image it contains:
+  // The layout only needs to know the images' size. The rest is decoded by
+  // LoadDeferred() once the image is drawn or exported.
+  if (filesystem && ReadImageSize())
   {
-    wxFSFile * fsfile;
-    #ifdef HAVE_OPENMP_TASKS
-    #pragma omp critical (OpenFSFile)
-    #endif
-    fsfile = filesystem->OpenFile(image);
-    if (fsfile)
-    { // open successful
+    m_isOk = true;
+    m_loadDeferred = true;
+    return;
+  }
+  DecodeImageData();
+}
+
+void Image::LoadDeferred()
+{
+  if (!m_loadDeferred)
+    return;
+  m_loadDeferred = false;
+  DecodeImageData();
+}
 
-      wxInputStream *istream = fsfile->GetStream();
+bool Image::ReadImageSize()
+{
+  if ((m_extension != wxT("png")) && (m_extension != wxT("gif")) &&
+      (m_extension != wxT("jpg")) && (m_extension != wxT("jpeg")))
+    return false;
+
+  wxMemoryInputStream input(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+  size_t width, height;
+  if (!ReadImageSize(&input, m_extension, width, height))
+    return false;
+  m_originalWidth = width;
+  m_originalHeight = height;
+  return true;
+}
+
+bool Image::ReadImageSize(wxInputStream *stream, const wxString &extension,
+                          size_t &width, size_t &height)
+{
+  if (stream == NULL)
+    return false;
+  unsigned char buf[24];
 
-      m_compressedImage = ReadCompressedImage(istream);
+  if (extension == wxT("png"))
+  {
+    // The signature is followed by the IHDR chunk that starts with the size
+    static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if ((stream->Read(buf, 24).LastRead() != 24) ||
+        (memcmp(buf, signature, 8) != 0) || (memcmp(buf + 12, "IHDR", 4) != 0))
+      return false;
+    width = (size_t(buf[16]) << 24) | (size_t(buf[17]) << 16) | (size_t(buf[18]) << 8) | buf[19];
+    height = (size_t(buf[20]) << 24) | (size_t(buf[21]) << 16) | (size_t(buf[22]) << 8) | buf[23];
+    return (width > 0) && (height > 0);
+  }
+
+  if (extension == wxT("gif"))
+  {
+    if ((stream->Read(buf, 10).LastRead() != 10) || (memcmp(buf, "GIF", 3) != 0))
+      return false;
+    width = buf[6] | (size_t(buf[7]) << 8);
+    height = buf[8] | (size_t(buf[9]) << 8);
+    return (width > 0) && (height > 0);
+  }
+
+  // A jpeg file is a list of segments. The size is stored in the "start of
+  // frame" segment, that may follow segments containing metadata or thumbnails.
+  if ((stream->Read(buf, 2).LastRead() != 2) || (buf[0] != 0xff) || (buf[1] != 0xd8))
+    return false;
+  std::vector<char> skip(4096);
+  while (true)
+  {
+    if ((stream->Read(buf, 2).LastRead() != 2) || (buf[0] != 0xff))
+      return false;
+    unsigned char marker = buf[1];
+    // Markers may be preceded by any number of fill bytes
+    while (marker == 0xff)
+    {
+      if (stream->Read(&marker, 1).LastRead() != 1)
+        return false;
+    }
+    // Segments without a length
+    if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd7)))
+      continue;
+    if ((marker == 0xd9) || (marker == 0xda))
+      return false;
+    if (stream->Read(buf, 2).LastRead() != 2)
+      return false;
+    size_t length = (size_t(buf[0]) << 8) | buf[1];
+    if (length < 2)
+      return false;
+    length -= 2;
+    if ((marker >= 0xc0) && (marker <= 0xcf) &&
+        (marker != 0xc4) && (marker != 0xc8) && (marker != 0xcc))
+    {
+      if ((length < 5) || (stream->Read(buf, 5).LastRead() != 5))
+        return false;
+      height = (size_t(buf[1]) << 8) | buf[2];
+      width = (size_t(buf[3]) << 8) | buf[4];
+      return (width > 0) && (height > 0);
     }
+    while (length > 0)
+    {
+      size_t chunk = wxMin(length, skip.size());
+      if (stream->Read(skip.data(), chunk).LastRead() != chunk)
+        return false;
+      length -= chunk;
+    }
+  }
+}
 
-    // Closing and deleting fsfile is important: If this line is missing
-    // opening .wxmx files containing hundreds of images might lead to a
-    // "too many open files" error.
+void Image::ReadImageData(wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove)
+{
+  if (filesystem)
+  {
+    // Images are stored without compression: Their data can be copied
+    // directly from the mapped archive.
+    const void *data;
+    size_t length;
+    if (filesystem->GetStoredEntry(image, data, length))
+    {
+      m_compressedImage.Clear();
+      m_compressedImage.AppendData(data, length);
+    }
+    else
+    {
+      std::unique_ptr<wxInputStream> istream = filesystem->OpenEntry(image);
+      if (istream)
+        m_compressedImage = ReadCompressedImage(istream.get());
+    }
   }
   else
   {
@@ -940,7 +1146,10 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
       }
     }
   }
+}
 
+void Image::DecodeImageData()
+{
   m_isOk = false;
 
   wxImage Image;
@@ -1031,10 +1240,6 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
       }
     }
   }
-  m_fs_keepalive_imagedata.reset();
-  #ifdef HAVE_OMP_HEADER
-  omp_unset_lock(&m_imageLoadLock);
-  #endif
 }
 
 void Image::Recalculate(double scale)
@@ -1101,9 +1306,4 @@ void Image::Recalculate(double scale)
     m_height = 100;
     m_width = 100;
   }
-  // Clear this cell's image cache if it doesn't contain an image of the size
-  // we need right now. Printing uses unscaled bitmaps, so the cache is left
-  // unchanged then.
-  if (!configuration->GetPrinting() && m_scaledBitmap.GetWidth() != m_width)
-    ClearCache();
 }
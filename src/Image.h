@@ -34,7 +34,7 @@
 #include <wx/image.h>
 
 #include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "ZipArchive.h"
 #include <wx/buffer.h>
 #include "nanoSVG/nanosvg.h"
 #include "nanoSVG/nanosvgrast.h"
@@ -86,10 +86,10 @@ public:
 
     \param config The pointer to the current configuration storage for the worksheet
     \param image The name of the file
-    \param filesystem The filesystem to load it from
+    \param filesystem The .wxmx archive to load it from. NULL = the operating system's filesystem
     \param remove true = Delete the file after loading it
    */
-  Image(Configuration **config, wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove = true);
+  Image(Configuration **config, wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove = true);
 
   ~Image();
 
@@ -102,13 +102,13 @@ public:
     are text-only they profit from being compressed and are stored in the 
     memory in their compressed form.
    */
-  void GnuplotSource(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<wxFileSystem> filesystem);
+  void GnuplotSource(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<ZipArchive> filesystem);
 
   //! Load the gnuplot source file from the system's filesystem
   void GnuplotSource(wxString gnuplotFilename, wxString dataFilename)
     {
       // Create an empty filesystem pointer (which means: Use the system's filesystem)
-      std::shared_ptr<wxFileSystem> filesystem;
+      std::shared_ptr<ZipArchive> filesystem;
       GnuplotSource(gnuplotFilename, dataFilename, filesystem);
     }
 
@@ -140,13 +140,11 @@ public:
   
   /*! Temporarily forget the scaled image in order to save memory
 
-    Will recreate the scaled image as soon as needed.
+    Will recreate the scaled image as soon as needed. The scaled images of
+    images that are merely scrolled out of view are kept in the BitmapCache
+    until its memory budget is exceeded.
    */
-  void ClearCache()
-    {
-      if ((m_scaledBitmap.GetWidth() > 1) || (m_scaledBitmap.GetHeight() > 1))
-        m_scaledBitmap.Create(1, 1);
-    }
+  void ClearCache();
   
   //! Returns the file name extension of the current image
   wxString GetExtension();
@@ -168,6 +166,23 @@ public:
   //! Returns the bitmap being displayed with custom scale
   wxBitmap GetBitmap(double scale = 1.0);
 
+  /*! Returns the bitmap to display without waiting for a svg image to be rasterized
+
+    Rasterizing a big svg image can take a long time. If a svg image is needed
+    in a size it hasn't been rasterized in, yet, this is done in a background
+    task. Until that task has finished the bitmap of the size the image has been
+    displayed in before - or, if there isn't one, an invalid bitmap - is
+    returned and ready is set to false.
+   */
+  wxBitmap GetBitmapOrPlaceholder(bool &ready);
+
+  /*! Starts creating the bitmap GetBitmap() will return in a background task
+
+    Used for images that are about to be scrolled into view. Uses the size the
+    last Recalculate() has calculated.
+   */
+  void PrefetchBitmap();
+
   //! Does the image show an actual image or an "broken image" symbol?
   bool IsOk();
   
@@ -230,16 +245,47 @@ protected:
   wxString m_extension;
   //! Does this image contain an actual image?
   bool m_isOk;
+  /*! Is only the size of the image known so far?
+
+    The image data has already been read into m_compressedImage, but is
+    decoded only by LoadDeferred().
+   */
+  bool m_loadDeferred = false;
   //! The gnuplot source file for this image, if any.
   wxString m_gnuplotSource;
   //! The gnuplot data file for this image, if any.
   wxString m_gnuplotData;
-  void LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove);
-  void LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<wxFileSystem> filesystem);
+  void LoadImage_Backgroundtask(wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove);
+  void LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<ZipArchive> filesystem);
+  void PrefetchBitmap_Backgroundtask(wxSize size);
+  //! Copies the image file into m_compressedImage
+  void ReadImageData(wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove);
+  //! Decodes the image in m_compressedImage
+  void DecodeImageData();
+  /*! Decodes the image data that has been left undecoded until now
+
+    Needs to be called with m_imageLoadLock held by every function that needs
+    more than the size of the image.
+   */
+  void LoadDeferred();
+  /*! Reads only the size of the image from the start of m_compressedImage
+
+    \retval false if the file format isn't one we know the header of or if the
+    header couldn't be read.
+   */
+  bool ReadImageSize();
+  //! Reads the size of a png, gif or jpeg image from the start of its file
+  static bool ReadImageSize(wxInputStream *stream, const wxString &extension,
+                            size_t &width, size_t &height);
+  /*! Decodes the image and scales it to the given size
+
+    Can be called from a background task once the image has been loaded.
+   */
+  wxImage CreateScaledImage(long width, long height);
 
 private:
   //! Loads an image from a file
-  void LoadImage(wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove = true);
+  void LoadImage(wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove = true);
   //! Reads the compressed image into a memory buffer
   static wxMemoryBuffer ReadCompressedImage(wxInputStream *data);  
   Configuration **m_configuration;
@@ -253,8 +299,8 @@ private:
   NSVGimage* m_svgImage;
   std::unique_ptr<struct NSVGrasterizer, decltype(std::free)*> m_svgRast{nullptr, std::free};
 
-  std::shared_ptr<wxFileSystem> m_fs_keepalive_gnuplotdata;
-  std::shared_ptr<wxFileSystem> m_fs_keepalive_imagedata;
+  std::shared_ptr<ZipArchive> m_fs_keepalive_gnuplotdata;
+  std::shared_ptr<ZipArchive> m_fs_keepalive_imagedata;
   #ifdef HAVE_OMP_HEADER
   omp_lock_t m_gnuplotLock;
   omp_lock_t m_imageLoadLock;
@@ -36,7 +36,6 @@
 #include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <wx/clipbrd.h>
 #include <wx/mstream.h>
 
@@ -75,7 +74,7 @@ ImgCell::ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointer
 int ImgCell::s_counter = 0;
 
 // constructor which load image
-ImgCell::ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointers, wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove)
+ImgCell::ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointers, wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove)
   : Cell(parent, config, cellPointers)
 {
   m_nextToDraw = NULL;
@@ -116,6 +115,7 @@ ImgCell::~ImgCell()
 
 void ImgCell::MarkAsDeleted()
 {
+  m_cellPointers->m_cellsWaitingForImage.erase(this);
   ClearCache();
   Cell::MarkAsDeleted();
 }
@@ -132,7 +132,7 @@ wxString ImgCell::GetToolTip(const wxPoint &point)
                "One example of the latter would be: Gnuplot refuses to plot entirely "
                "empty images"));
     else
-      return m_toolTip;
+      return GetLocalToolTip();
   }
   else
     return wxEmptyString;
@@ -197,7 +197,23 @@ void ImgCell::Draw(wxPoint point)
     if (m_drawRectangle || m_drawBoundingBox)
       dc->DrawRectangle(wxRect(point.x, point.y - m_center, m_width, m_height));
 
-    wxBitmap bitmap = (configuration->GetPrinting() ? m_image->GetUnscaledBitmap() : m_image->GetBitmap());
+    bool ready = true;
+    wxBitmap bitmap = (configuration->GetPrinting() ? m_image->GetUnscaledBitmap() : m_image->GetBitmapOrPlaceholder(ready));
+    if (!ready)
+    {
+      // Draw the image again as soon as it has been rendered in the background
+      m_cellPointers->m_cellsWaitingForImage[this] = 0;
+      // Until then show the image in the size it has been displayed in before
+      if (bitmap.IsOk())
+      {
+        bitmapDC.SelectObject(bitmap);
+        dc->StretchBlit(point.x + m_imageBorderWidth, point.y - m_center + m_imageBorderWidth,
+                        m_width - 2 * m_imageBorderWidth, m_height - 2 * m_imageBorderWidth,
+                        &bitmapDC, 0, 0, bitmap.GetWidth(), bitmap.GetHeight());
+      }
+      m_drawBoundingBox = false;
+      return;
+    }
     bitmapDC.SelectObject(bitmap);
 
     int xDst = point.x + m_imageBorderWidth;
@@ -222,9 +238,6 @@ void ImgCell::Draw(wxPoint point)
     else
       dc->Blit(xDst, yDst, widthDst, heightDst, &bitmapDC, xSrc, ySrc);
   }
-  else
-    // The cell isn't drawn => No need to keep it's image cache for now.
-    ClearCache();
 
   // The next time we need to draw a bounding box we will be informed again.
   m_drawBoundingBox = false;
@@ -299,14 +312,12 @@ wxString ImgCell::ToXML()
 {
   wxString basename = m_cellPointers->WXMXGetNewFileName();
 
-  // add the file to memory
+  // schedule the file to be stored in the .wxmx file
   if (m_image)
   {
     if (m_image->GetCompressedImage())
-      wxMemoryFSHandler::AddFile(basename + m_image->GetExtension(),
-                                 m_image->GetCompressedImage().GetData(),
-                                 m_image->GetCompressedImage().GetDataLen()
-      );
+      m_cellPointers->WXMXAddFile(basename + m_image->GetExtension(),
+                                  m_image->GetCompressedImage());
   }
 
   wxString flags;
@@ -342,26 +353,12 @@ wxString ImgCell::ToXML()
     if(gnuplotSource != wxEmptyString)
     {
       flags += " gnuplotsource=\"" + gnuplotSource + "\"";
-      wxMemoryBuffer data = m_image->GetGnuplotSource();
-      if(data.GetDataLen() > 0)
-      {
-        wxMemoryFSHandler::AddFile(gnuplotSource,
-                                   data.GetData(),
-                                   data.GetDataLen()
-          );
-      }
+      m_cellPointers->WXMXAddGnuplotFile(gnuplotSource, m_image, false);
     }
     if(gnuplotData != wxEmptyString)
     {
       flags += " gnuplotdata=\"" + gnuplotData + "\"";
-      wxMemoryBuffer data = m_image->GetGnuplotData();
-      if(data.GetDataLen() > 0)
-      {
-        wxMemoryFSHandler::AddFile(gnuplotData,
-                                   data.GetData(),
-                                   data.GetDataLen()
-          );
-      }
+      m_cellPointers->WXMXAddGnuplotFile(gnuplotData, m_image, true);
     }
   }
   
@@ -28,14 +28,14 @@
 #include "Image.h"
 
 #include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "ZipArchive.h"
 
 class ImgCell : public Cell
 {
 public:
   ImgCell(Cell *parent, Configuration **config, CellPointers *cellpointers);
   ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointers, wxMemoryBuffer image, wxString type);
-  ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointers, wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove = true);
+  ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointers, wxString image, std::shared_ptr<ZipArchive> filesystem, bool remove = true);
 
   ImgCell(Cell *parent, Configuration **config, CellPointers *cellPointers, const wxBitmap &bitmap);
   ImgCell(const ImgCell &cell);
@@ -46,7 +46,7 @@ public:
   ImgCell &operator=(const ImgCell&) = delete;
 
   //! Tell the image which gnuplot files it was made from
-  void GnuplotSource(wxString sourcefile, wxString datafile, std::shared_ptr<wxFileSystem> filesystem)
+  void GnuplotSource(wxString sourcefile, wxString datafile, std::shared_ptr<ZipArchive> filesystem)
     {
       if(m_image != NULL)
         m_image->GnuplotSource(sourcefile,datafile, filesystem);
@@ -95,6 +95,10 @@ public:
   virtual void ClearCache() override
   { if (m_image)m_image->ClearCache(); }
 
+  //! Starts decoding the image in the background
+  virtual void PrefetchImage() override
+  { if (m_image)m_image->PrefetchBitmap(); }
+
   virtual wxString GetToolTip(const wxPoint &point) override;
   
   //! Sets the bitmap that is shown
@@ -30,6 +30,7 @@
 #include <wx/intl.h>
 
 #include "MathParser.h"
+#include "XmlPullReader.h"
 
 #include "Version.h"
 #include "ExptCell.h"
@@ -79,7 +80,9 @@ wxXmlNode *MathParser::GetNextTag(wxXmlNode *node)
   return SkipWhitespaceNode(node);
 }
 
-MathParser::MathParser(Configuration **cfg, Cell::CellPointers *cellPointers, wxString zipfile)
+MathParser::MathParser(Configuration **cfg, Cell::CellPointers *cellPointers,
+                       std::shared_ptr<ZipArchive> wxmxFile) :
+  m_fileSystem(wxmxFile)
 {
   m_configuration = cfg;
   m_cellPointers = cellPointers;
@@ -130,6 +133,15 @@ MathParser::MathParser(Configuration **cfg, Cell::CellPointers *cellPointers, wx
     m_innerTags[wxT("cell")] = &MathParser::ParseCellTag;
     m_innerTags[wxT("ascii")] = &MathParser::ParseCharCode;
   }
+  if(m_streamedTags.empty())
+  {
+    m_streamedTags.push_back(wxT("math"));
+    m_streamedTags.push_back(wxT("mth"));
+    m_streamedTags.push_back(wxT("line"));
+    m_streamedTags.push_back(wxT("r"));
+    m_streamedTags.push_back(wxT("mrow"));
+    m_streamedTags.push_back(wxT("p"));
+  }
   if(m_groupTags.empty())
   {
     m_groupTags[wxT("code")] = &MathParser::GroupCellFromCodeTag;
@@ -144,11 +156,6 @@ MathParser::MathParser(Configuration **cfg, Cell::CellPointers *cellPointers, wx
     m_groupTags[wxT("heading6")] = &MathParser::GroupCellHeading6Tag;
   }
   m_highlight = false;
-  if (zipfile.Length() > 0)
-  {
-    m_fileSystem = std::unique_ptr<wxFileSystem>(new wxFileSystem());
-    m_fileSystem->ChangePathTo(zipfile + wxT("#zip:/"), true);
-  }
 }
 
 MathParser::~MathParser()
@@ -258,7 +265,7 @@ Cell *MathParser::ParseImageTag(wxXmlNode *node)
   {
     if (node->GetAttribute(wxT("del"), wxT("yes")) != wxT("no"))
     {
-      std::shared_ptr <wxFileSystem> noFS;
+      std::shared_ptr<ZipArchive> noFS;
       if(wxImage::GetImageCount(filename) < 2)
         imageCell = new ImgCell(NULL, m_configuration, m_cellPointers, filename, noFS, true);
       else
@@ -273,7 +280,7 @@ Cell *MathParser::ParseImageTag(wxXmlNode *node)
         (wxFileExists((*m_configuration)->GetWorkingDirectory() + wxT("/") + filename))
         )
         filename = (*m_configuration)->GetWorkingDirectory() + wxT("/") + filename;
-      std::shared_ptr <wxFileSystem> noFS;
+      std::shared_ptr<ZipArchive> noFS;
       if(wxImage::GetImageCount(filename) < 2)           
         imageCell = new ImgCell(NULL, m_configuration, m_cellPointers, filename, noFS, false);
       else
@@ -339,8 +346,12 @@ Cell *MathParser::ParseOutputLabelTag(wxXmlNode *node)
 
 Cell *MathParser::ParseMthTag(wxXmlNode *node)
 {
-  Cell *retval;
-  retval = ParseTag(node->GetChildren());
+  return BreakLine(ParseTag(node->GetChildren()));
+}
+
+Cell *MathParser::BreakLine(Cell *contents)
+{
+  Cell *retval = contents;
   if (retval != NULL)
     retval->ForceBreakLine(true);
   else
@@ -489,6 +500,66 @@ Cell *MathParser::HandleNullPointer(Cell *cell)
   return (cell);
 }
 
+wxString MathParser::EditorTagText(wxXmlNode *node)
+{
+  wxString text = wxEmptyString;
+  wxXmlNode *line = node->GetChildren();
+  while (line)
+  {
+    if (line->GetName() == wxT("line"))
+    {
+      if (!text.IsEmpty())
+        text += wxT("\n");
+      text += line->GetNodeContent();
+    }
+    line = line->GetNext();
+  } // end while
+  return text;
+}
+
+void MathParser::FindInputEditorTags(wxXmlNode *node, std::vector<wxXmlNode *> &editorTags)
+{
+  for(; node != NULL; node = node->GetNext())
+  {
+    if(node->GetType() != wxXML_ELEMENT_NODE)
+      continue;
+    if(node->GetName() == wxT("editor"))
+    {
+      if(node->GetAttribute(wxT("type"), wxT("input")) == wxT("input"))
+        editorTags.push_back(node);
+    }
+    else
+      FindInputEditorTags(node->GetChildren(), editorTags);
+  }
+}
+
+void MathParser::TokenizeEditorTags(wxXmlNode *node)
+{
+  std::vector<wxXmlNode *> editorTags;
+  if(node != NULL)
+    FindInputEditorTags(node->GetChildren(), editorTags);
+
+  std::vector<wxString> code(editorTags.size());
+  std::vector<MaximaTokenizer::TokenList> tokens(editorTags.size());
+  Configuration *configuration = *m_configuration;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskloop shared(editorTags, code, tokens)
+  #endif
+  for(size_t i = 0; i < editorTags.size(); i++)
+  {
+    // The same conversions EditorCell::SetValue() and EditorCell::StyleText()
+    // apply to the text before tokenizing it
+    code[i] = EditorTagText(editorTags[i]);
+    code[i].Replace(wxT("\u2028"), "\n");
+    code[i].Replace(wxT("\u2029"), "\n");
+    code[i].Replace(wxT("\r"), wxT(" "));
+    tokens[i] = MaximaTokenizer(code[i], configuration).PopTokens();
+  }
+
+  for(size_t i = 0; i < editorTags.size(); i++)
+    m_editorTokens[editorTags[i]] = std::make_pair(code[i], std::move(tokens[i]));
+}
+
 Cell *MathParser::ParseEditorTag(wxXmlNode *node)
 {
   EditorCell *editor = new EditorCell(NULL, m_configuration, m_cellPointers);
@@ -510,19 +581,15 @@ Cell *MathParser::ParseEditorTag(wxXmlNode *node)
   else if (type == wxT("heading6"))
     editor->SetType(MC_TYPE_HEADING6);
 
-  wxString text = wxEmptyString;
-  wxXmlNode *line = node->GetChildren();
-  while (line)
+  // If TokenizeEditorTags() has already tokenized our code we can use its result.
+  auto tokens = m_editorTokens.find(node);
+  if (tokens != m_editorTokens.end())
   {
-    if (line->GetName() == wxT("line"))
-    {
-      if (!text.IsEmpty())
-        text += wxT("\n");
-      text += line->GetNodeContent();
-    }
-    line = line->GetNext();
-  } // end while
-  editor->SetValue(text);
+    editor->SetTokens(tokens->second.first, std::move(tokens->second.second));
+    m_editorTokens.erase(tokens);
+  }
+
+  editor->SetValue(EditorTagText(node));
   return editor;
 }
 
@@ -726,7 +793,7 @@ Cell *MathParser::ParseFunTag(wxXmlNode *node)
 Cell *MathParser::ParseText(wxXmlNode *node, TextStyle style)
 {
   wxString str;
-  TextCell *retval = NULL;
+  CellListBuilder retval;
   if ((node != NULL) && ((str = node->GetContent()) != wxEmptyString))
   {
     str.Replace(wxT("-"), wxT("\u2212")); // unicode minus sign
@@ -760,21 +827,17 @@ Cell *MathParser::ParseText(wxXmlNode *node, TextStyle style)
       
       cell->SetHighlight(m_highlight);
       cell->SetValue(lines.GetNextToken());
-      if (retval == NULL)
-        retval = cell;
-      else
-      {
+      if (retval.GetHead() != NULL)
         cell->ForceBreakLine(true);
-        retval->AppendCell(cell);
-      };
+      retval.Append(cell);
     }
   }
 
-  if (retval == NULL)
-    retval = new TextCell(NULL, m_configuration, m_cellPointers);
+  if (retval.GetHead() == NULL)
+    retval.Append(new TextCell(NULL, m_configuration, m_cellPointers));
 
-  ParseCommonAttrs(node, retval);
-  return retval;
+  ParseCommonAttrs(node, retval.GetHead());
+  return retval.GetHead();
 }
 
 void MathParser::ParseCommonAttrs(wxXmlNode *node, Cell *cell)
@@ -858,9 +921,14 @@ Cell *MathParser::ParseParenTag(wxXmlNode *node)
 {
   wxXmlNode *child = node->GetChildren();
   child = SkipWhitespaceNode(child);
-  ParenCell *cell = new ParenCell(NULL, m_configuration, m_cellPointers);
   // No special Handling for NULL args here: They are completely legal in this case.
-  cell->SetInner(ParseTag(child, true), m_ParserStyle);
+  return ParenCellFromContents(node, ParseTag(child, true));
+}
+
+Cell *MathParser::ParenCellFromContents(wxXmlNode *node, Cell *inner)
+{
+  ParenCell *cell = new ParenCell(NULL, m_configuration, m_cellPointers);
+  cell->SetInner(inner, m_ParserStyle);
   cell->SetHighlight(m_highlight);
   cell->SetStyle(TS_VARIABLE);
   if (node->GetAttributes() != NULL)
@@ -981,8 +1049,8 @@ Cell *MathParser::ParseTableTag(wxXmlNode *node)
 
 Cell *MathParser::ParseTag(wxXmlNode *node, bool all)
 {
-  Cell *retval = NULL;
-  Cell *cell = NULL;
+  // The list of cells we parsed so far
+  CellListBuilder cells;
   bool warning = all;
   wxString altCopy;
 
@@ -1005,40 +1073,25 @@ Cell *MathParser::ParseTag(wxXmlNode *node, bool all)
       if ((tmp == NULL) && (node->GetChildren()))
         tmp = ParseTag(node->GetChildren());
 
-      // Append the cell we found (tmp) to the list of cells we parsed so far (cell).
+      // Append the cell we found (tmp) to the list of cells we parsed so far.
       if (tmp != NULL)
       {
         ParseCommonAttrs(node, tmp);
-        if (cell == NULL)
-          cell = tmp;
-        else
-          cell->AppendCell(tmp);
+        cells.Append(tmp);
       }
     }
     else
     {
       // We didn't get a tag but got a text cell => Parse the text.
-      if (cell == NULL)
-        cell = ParseText(node);
-      else
-        cell->AppendCell(ParseText(node));
+      cells.Append(ParseText(node));
     }
 
-    if (cell != NULL)
-    {
-      // Append the new cell to the return value
-      if (retval == NULL)
-        retval = cell;
-      else
-        cell = cell->m_next;
-    }
-    else if ((warning) && (!all))
+    if ((cells.GetHead() == NULL) && (warning) && (!all))
     {
       // Tell the user we ran into problems.
       wxString name;
       name.Trim(true);
       name.Trim(false);
-      if (cell != NULL) name = cell->ToString();
       if (name.Length() != 0)
       {
         LoggingMessageBox(_("Parts of the document will not be loaded correctly:\nFound unknown XML Tag name " + name),
@@ -1054,10 +1107,37 @@ Cell *MathParser::ParseTag(wxXmlNode *node, bool all)
       break;
   }
 
-  return retval;
+  return cells.GetHead();
+}
+
+Cell *MathParser::ParseStreamedContents(XmlPullReader &xml)
+{
+  CellListBuilder cells;
+  wxXmlNode *node;
+  while ((node = xml.ReadNode()) != NULL)
+  {
+    std::unique_ptr<wxXmlNode> child(node);
+    if (xml.ElementOpened())
+      cells.Append(ParseStreamedTag(xml, child.get()));
+    else if (SkipWhitespaceNode(child.get()) != NULL)
+      cells.Append(ParseTag(child.get(), false));
+  }
+  return cells.GetHead();
+}
+
+Cell *MathParser::ParseStreamedTag(XmlPullReader &xml, wxXmlNode *node)
+{
+  wxString tagName(node->GetName());
+  Cell *tmp = ParseStreamedContents(xml);
+  if (tagName == wxT("p"))
+    tmp = ParenCellFromContents(node, tmp);
+  else if ((tagName == wxT("mth")) || (tagName == wxT("line")))
+    tmp = BreakLine(tmp);
+  ParseCommonAttrs(node, tmp);
+  return tmp;
 }
 
-Cell *MathParser::ParseLine(wxString s, CellType style)
+Cell *MathParser::ParseLine(const wxString &s, CellType style)
 {
   m_ParserStyle = style;
   m_FracStyle = FracCell::FC_NORMAL;
@@ -1084,21 +1164,22 @@ Cell *MathParser::ParseLine(wxString s, CellType style)
       showLength = 50000;    
   }
 
-  m_graphRegex.Replace(&s, wxT("\uFFFD"));
-
   if (((long) s.Length() < showLength) || (showLength == 0))
   {
-
-    wxXmlDocument xml;
-
-    wxStringInputStream xmlStream(s);
-
-    xml.Load(xmlStream, wxT("UTF-8"), wxXMLDOC_KEEP_WHITESPACE_NODES);
-
-    wxXmlNode *doc = xml.GetRoot();
-
-    if (doc != NULL)
-      cell = ParseTag(doc->GetChildren());
+    // Convert the xml to cells while reading it: The lines, rows and parenthesis
+    // that wrap the output are converted one child at a time and only the xml
+    // of each of their children is read as a whole => We never need to keep
+    // the xml tree for the whole output in memory.
+    XmlPullReader xml(s);
+    xml.StreamElements(m_streamedTags);
+    std::unique_ptr<wxXmlNode> doc(xml.ReadStartTag());
+    if ((doc != NULL) && (!xml.EmptyElement()))
+      cell = ParseStreamedContents(xml);
+    if (xml.Error())
+    {
+      wxLogMessage(_("Received malformed XML from maxima"));
+      wxDELETE(cell);
+    }
   }
   else
   {
@@ -1113,7 +1194,7 @@ Cell *MathParser::ParseLine(wxString s, CellType style)
   return cell;
 }
 
-wxRegEx MathParser::m_graphRegex(wxT("[[:cntrl:]]"));
 MathParser::MathCellFunctionHash MathParser::m_innerTags;
+std::vector<wxString> MathParser::m_streamedTags;
 MathParser::GroupCellFunctionHash MathParser::m_groupTags;
 
@@ -31,15 +31,20 @@ The header file for the xml cell parser
 #include <wx/xml/xml.h>
 
 #include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "ZipArchive.h"
 #include <wx/regex.h>
 #include <wx/hashmap.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "Cell.h"
 #include "TextCell.h"
 #include "EditorCell.h"
 #include "FracCell.h"
 #include "GroupCell.h"
 
+class XmlPullReader;
+
 /*! This class handles parsing the xml representation of a cell tree.
 
 The xml representation of a cell tree can be found in the file contents.xml 
@@ -53,7 +58,8 @@ public:
      \todo I guess we could increase the performance further by putting the 
      most-frequently-used tags to the front of the list.
    */
-  MathParser(Configuration **cfg, Cell::CellPointers *cellPointers, wxString zipfile = wxEmptyString);
+  MathParser(Configuration **cfg, Cell::CellPointers *cellPointers,
+             std::shared_ptr<ZipArchive> wxmxFile = {});
   //! This class doesn't have a copy constructor
   MathParser(const MathParser&) = delete;
   //! This class doesn't have a = operator
@@ -65,7 +71,7 @@ public:
    * Parse the string s, which is (correct) xml fragment.
    * Put the result in line.
    */
-  Cell *ParseLine(wxString s, CellType style = MC_TYPE_DEFAULT);
+  Cell *ParseLine(const wxString &s, CellType style = MC_TYPE_DEFAULT);
   /***
    * Parse the node and return the corresponding tag.
    */
@@ -73,6 +79,16 @@ public:
   Cell *ParseTag(wxXmlNode *node, bool all = true);
   Cell *ParseTagContents(wxXmlNode *node);
 
+  /*! Tokenize the code of all input editor tags below node in parallel
+
+    Tokenizing the code is one of the most time-consuming steps of creating
+    the cells of a big document, and the only one that doesn't need to measure
+    text. The tokens are handed to the EditorCells that ParseTag() later
+    creates for these tags, which therefore don't need to tokenize their code
+    on the GUI thread one after another.
+  */
+  void TokenizeEditorTags(wxXmlNode *node);
+
 private:
   //! A storage for a tag and the function to call if one encounters it
   class TagFunction
@@ -108,6 +124,11 @@ private:
   /*! Who you gonna call if you encounter any of these math cell tags?
    */
   static MathCellFunctionHash m_innerTags;
+  /*! The tags ParseLine() converts to cells while their contents is still being read
+
+    These are the tags that typically contain the whole output maxima has sent.
+   */
+  static std::vector<wxString> m_streamedTags;
   //! A list of functions to call on encountering all types of GroupCell tags
   static GroupCellFunctionHash m_groupTags;
   //! Parses attributes that apply to nearly all types of cells
@@ -136,6 +157,18 @@ private:
    */
   wxXmlNode *SkipWhitespaceNode(wxXmlNode *node);
 
+  /*! Parses the children of the element xml has just opened to a list of cells
+
+    Reads the xml up to and including the closing tag of that element.
+   */
+  Cell *ParseStreamedContents(XmlPullReader &xml);
+  /*! Parses an element from m_streamedTags whose children are still to be read
+
+    Does the same as ParseTag(node, false) would have done, if node had been read
+    including all of its children.
+   */
+  Cell *ParseStreamedTag(XmlPullReader &xml, wxXmlNode *node);
+
   /*! \defgroup GroupCellParsing Methods that generate GroupCells from XML
     @{
   */
@@ -196,6 +229,10 @@ private:
   */
   //! Parse an editor XML tag to a Cell. 
   Cell *ParseEditorTag(wxXmlNode *node);
+  //! The text an editor XML tag contains
+  static wxString EditorTagText(wxXmlNode *node);
+  //! Appends all input editor tags below node to editorTags
+  static void FindInputEditorTags(wxXmlNode *node, std::vector<wxXmlNode *> &editorTags);
   //! Parse an frac XML tag to a Cell. 
   Cell *ParseFracTag(wxXmlNode *node);
   //! Parse a text XML tag to a Cell. 
@@ -223,6 +260,8 @@ private:
     \todo Does such a thing actually exist?
    */
   Cell *ParseMthTag(wxXmlNode *node);
+  //! Makes the cells of a math-in-maths tag start a new line
+  Cell *BreakLine(Cell *contents);
   //! Parse an output label tag to a Cell. 
   Cell *ParseOutputLabelTag(wxXmlNode *node);
   //! Parse a string tag to a Cell. 
@@ -263,6 +302,8 @@ private:
   Cell *ParseLimitTag(wxXmlNode *node);
   //! Parse a parenthesis() tag to a Cell. 
   Cell *ParseParenTag(wxXmlNode *node);
+  //! Creates the ParenCell for a parenthesis tag that contains inner
+  Cell *ParenCellFromContents(wxXmlNode *node, Cell *inner);
   //! Parse a super-and-subscript cell tag to a Cell. 
   Cell *ParseSubSupTag(wxXmlNode *node);
   //! Parse a pre-and-post-super-and-subscript cell tag to a Cell. 
@@ -270,15 +311,14 @@ private:
   // @}
   //! The last user defined label
   wxString m_userDefinedLabel;
-  //! A RegEx that catches the last graphics placeholder
-  static wxRegEx m_graphRegex;
-
   CellType m_ParserStyle;
   int m_FracStyle;
   Cell::CellPointers *m_cellPointers;
   Configuration **m_configuration;
   bool m_highlight;
-  std::shared_ptr<wxFileSystem> m_fileSystem; // used for loading pictures in <img> and <slide>
+  std::shared_ptr<ZipArchive> m_fileSystem; // used for loading pictures in <img> and <slide>
+  //! The code and its tokens TokenizeEditorTags() has found for each editor tag
+  std::unordered_map<wxXmlNode *, std::pair<wxString, MaximaTokenizer::TokenList>> m_editorTokens;
 };
 
 #endif // MATHPARSER_H
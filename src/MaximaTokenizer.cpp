@@ -30,9 +30,114 @@
 #include <wx/wx.h>
 #include <wx/string.h>
 #include <vector>
+#include <iterator>
+#include <unordered_set>
 
 MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration)
 {  
+  Tokenize(commands, configuration);
+}
+
+MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration,
+                                 const wxString &oldCommands, TokenList &&oldTokens)
+{
+  // In lisp mode the start of the text is tokenized differently to the rest.
+  if (configuration->InLispMode() || oldTokens.empty())
+  {
+    Tokenize(commands, configuration);
+    return;
+  }
+
+  // Find the part of the text that has been changed
+  size_t oldLength = oldCommands.Length();
+  size_t newLength = commands.Length();
+  size_t prefix = 0;
+  wxString::const_iterator oldChar = oldCommands.begin();
+  wxString::const_iterator newChar = commands.begin();
+  while ((oldChar != oldCommands.end()) && (newChar != commands.end()) &&
+         (*oldChar == *newChar))
+  {
+    ++oldChar;
+    ++newChar;
+    ++prefix;
+  }
+  size_t maxSuffix = wxMin(oldLength, newLength) - prefix;
+  size_t suffix = 0;
+  wxString::const_reverse_iterator oldRChar = oldCommands.rbegin();
+  wxString::const_reverse_iterator newRChar = commands.rbegin();
+  while ((suffix < maxSuffix) && (*oldRChar == *newRChar))
+  {
+    ++oldRChar;
+    ++newRChar;
+    ++suffix;
+  }
+
+  // Find the last line start in front of the change we can restart tokenizing
+  // at. Newlines in strings and comments are part of the string or comment token,
+  // so a newline token always is outside of them. But whether a name is a
+  // function or a variable depends on the next char that isn't a space - which
+  // might be the first char in the next line.
+  size_t restartToken = 0;
+  size_t restartPos = 0;
+  size_t pos = 0;
+  bool nameInFront = false;
+  for (size_t i = 0; (i < oldTokens.size()) && (pos <= prefix); i++)
+  {
+    if ((i > 0) && (!nameInFront) && (oldTokens[i - 1].GetText() == wxT("\n")))
+    {
+      restartToken = i;
+      restartPos = pos;
+    }
+    const wxString &text = oldTokens[i].GetText();
+    if (text.IsEmpty() || !(GetCharClass(text[0]) & (CC_SPACE | CC_LINEBREAK)))
+      nameInFront = (oldTokens[i].GetStyle() == TS_CODE_VARIABLE) ||
+        (oldTokens[i].GetStyle() == TS_CODE_FUNCTION);
+    pos += text.Length();
+  }
+
+  m_tokens.reserve(oldTokens.size());
+  for (size_t i = 0; i < restartToken; i++)
+    m_tokens.push_back(std::move(oldTokens[i]));
+  m_unchangedTokens = restartToken;
+
+  Resync resync(oldTokens);
+  resync.m_oldToken = restartToken;
+  resync.m_oldPos = restartPos;
+  resync.m_newPos = restartPos;
+  resync.m_countedTokens = restartToken;
+  resync.m_changeEnd = newLength - suffix;
+  resync.m_oldLength = oldLength;
+  resync.m_newLength = newLength;
+  Tokenize(commands, commands.begin() + restartPos, configuration, &resync);
+}
+
+bool MaximaTokenizer::Resynchronize(Resync &resync)
+{
+  for (; resync.m_countedTokens < m_tokens.size(); resync.m_countedTokens++)
+    resync.m_newPos += m_tokens[resync.m_countedTokens].GetText().Length();
+  if (resync.m_newPos < resync.m_changeEnd)
+    return false;
+
+  // Where the current position was in the old text
+  size_t oldPos = resync.m_newPos + resync.m_oldLength - resync.m_newLength;
+  TokenList &oldTokens = resync.m_oldTokens;
+  while ((resync.m_oldToken < oldTokens.size()) &&
+         ((resync.m_oldPos < oldPos) || oldTokens[resync.m_oldToken].GetText().IsEmpty()))
+    resync.m_oldPos += oldTokens[resync.m_oldToken++].GetText().Length();
+  if ((resync.m_oldPos != oldPos) || (resync.m_oldToken >= oldTokens.size()))
+    return false;
+
+  // A token starts at the same place in the unchanged rest of the text as in the
+  // old text. As tokenizing doesn't depend on the text in front of a token the
+  // rest of the old tokens is still valid.
+  m_tokens.insert(m_tokens.end(),
+                  std::make_move_iterator(oldTokens.begin() + resync.m_oldToken),
+                  std::make_move_iterator(oldTokens.end()));
+  return true;
+}
+
+void MaximaTokenizer::Tokenize(const wxString &commands, Configuration *configuration)
+{
   // ----------------------------------------------------------------
   // --------------------- Step one:                -----------------
   // --------------------- Break a line into tokens -----------------
@@ -54,122 +159,104 @@ MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration
     if(!token.IsEmpty())
       m_tokens.emplace_back(token, TS_CODE_LISP);
   }
-  while (it < commands.end())
+  Tokenize(commands, it, configuration);
+}
+
+void MaximaTokenizer::Tokenize(const wxString &commands, wxString::const_iterator it,
+                               Configuration *configuration, Resync *resync)
+{
+  const wxString::const_iterator end = commands.end();
+  while (it < end)
   {
+    if (resync && Resynchronize(*resync))
+      return;
+
     // Determine the current char and the one that will follow it
     wxChar Ch = *it;
+    unsigned char charClass = GetCharClass(Ch);
+    wxString::const_iterator start(it);
     wxString::const_iterator it2(it);
-    if(it2 < commands.end())
-      ++it2;
-    wxChar nextChar;
-
-    if(it2 < commands.end())
-      nextChar = *it2;
-    else
-      nextChar = wxT(' ');
+    ++it2;
+    wxChar nextChar = (it2 < end) ? wxChar(*it2) : wxChar(wxT(' '));
 
     // Handle newline characters (hard+soft line break)
-    if (m_linebreaks.Contains(Ch))
+    if (charClass & CC_LINEBREAK)
     {
-      m_tokens.emplace_back(wxChar(Ch));
+      m_tokens.emplace_back(wxString(Ch));
       ++it;
       continue;
     }
     // Check for comments
     if ((Ch == '/') && ((nextChar == wxT('*')) || (nextChar == wxT('\u00B7'))))
     {
-      wxString token;
-      // Add the comment start
-      token+=*it;++it;
-      token+=*it;++it;
+      // Skip the comment start
+      it = it2;
+      ++it;
 
       int commentDepth = 0;
-      while (it < commands.end())
+      while (it < end)
       {
         // Handle escaped chars
         if(*it == '\\')
         {
-          token += *it;
           ++it;
-          if(it < commands.end())
-          {
-            token += *it;
+          if(it < end)
             ++it;
-          }
           continue;
         }
         
         wxString::const_iterator it3(it);
-        if(it3 < commands.end())
-          ++it3;
-        wxChar nextCh = ' ';
-        if(it3 < commands.end())
-          nextCh = *it3;
+        ++it3;
+        wxChar nextCh = (it3 < end) ? wxChar(*it3) : wxChar(' ');
 
         // handle comment begins within comments.
         if((*it == '/') && ((nextCh == '*') || (nextCh == wxT('\u00B7'))))
         {
           commentDepth++;
-          token += *it;
-          ++it;
-          if(it < commands.end())
-          {
-            token += *it;
+          it = it3;
+          if(it < end)
             ++it;
-          }
           continue;
         }
         // handle comment endings
         if(((*it == '*') || (*it == wxT('\u00B7'))) && (nextCh == '/'))
         {
           commentDepth--;
-          token += *it;
-          ++it;
-          if(it < commands.end())
-          {
-            token += *it;
+          it = it3;
+          if(it < end)
             ++it;
-          }
           if(commentDepth < 0)
             break;
           continue;
         }
-        if(it < commands.end())
-        {
-          token += *it;
-          ++it;
-        }
+        ++it;
       }
-      m_tokens.emplace_back(token, TS_CODE_COMMENT);
+      m_tokens.emplace_back(wxString(start, it), TS_CODE_COMMENT);
       continue;
     }
     // Handle operators and :lisp commands
-    if (Operators().Find(Ch) != wxNOT_FOUND)
+    if (charClass & CC_OPERATOR)
     {
       if(Ch == ':')
       {
         wxString breakCommand;
         wxString::const_iterator it3(it);
         int len = 14;
-        while((len>0) && (it3 < commands.end()))
+        while((len>0) && (it3 < end))
         {
           len--;
-          breakCommand += wxString(*it3);
           ++it3;
         }
+        breakCommand = wxString(it, it3);
         if(
           breakCommand.StartsWith(":lisp ") ||
           breakCommand.StartsWith(":lisp-quiet ") ||
           breakCommand.StartsWith(":lisp\t") ||
           breakCommand.StartsWith(":lisp-quiet\t"))
         {
-          wxString token;
-          while((it < commands.end()) && (*it != '\n'))
-          {
-            token += wxString(*it);
+          while((it < end) && (*it != '\n'))
             ++it;
-          }
-          m_tokens.emplace_back(token, TS_CODE_LISP);
+          m_tokens.emplace_back(wxString(start, it), TS_CODE_LISP);
         }
           else
           {
@@ -179,14 +266,15 @@ MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration
       }
       else
       {
-        wxString token = wxString(Ch);
         if (configuration->GetChangeAsterisk())
         {
-          token.Replace(wxT("*"), wxT("\u00B7"));
-          token.Replace(wxT("-"), wxT("\u2212"));
+          if (Ch == wxT('*'))
+            Ch = wxT('\u00B7');
+          else if (Ch == wxT('-'))
+            Ch = wxT('\u2212');
         }
         
-        m_tokens.emplace_back(token, TS_CODE_OPERATOR);
+        m_tokens.emplace_back(wxString(Ch), TS_CODE_OPERATOR);
         ++it;
       }
       continue;
@@ -194,189 +282,162 @@ MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration
     // Handle strings
     if (Ch == wxT('\"'))
     {
-      wxString token;
-      // Add the opening quote
-      token = Ch;
+      // Skip the opening quote
       ++it;
 
-      // Add the string contents
-      while (it < commands.end())
+      // Skip the string contents
+      while (it < end)
       {
         Ch = *it;
-        token += Ch;
         ++it;
         if(Ch == wxT('\\'))
         {
-          if(it < commands.end())
-          {
-            token += *it;
+          if(it < end)
             ++it;
-          }
         }
         else if(Ch == wxT('\"'))
           break;
       }
-      m_tokens.emplace_back(token, TS_CODE_STRING);
+      m_tokens.emplace_back(wxString(start, it), TS_CODE_STRING);
       continue;
     }
     // Handle number-like symbols
-    if(UnicodeNumbers().Find(Ch) != wxNOT_FOUND)
+    if(charClass & CC_UNICODENUMBER)
     {
-       wxString token = Ch;
        ++it;
-       m_tokens.emplace_back(token, TS_CODE_NUMBER);
+       m_tokens.emplace_back(wxString(Ch), TS_CODE_NUMBER);
        continue;
     } 
     // Handle numbers. Numbers begin with a digit, but can continue with letters and can
     // contain a + or - that follows an e, f, g, h or l.
-    if (IsNum(Ch))
+    if (charClass & CC_NUM)
     {
-      wxString token;
       wxChar lastChar = *it;
-      while ((it < commands.end()) &&
-             (
-               (IsNum(*it) ||
-                ((*it >= 'a') && (*it <= 'z')) ||
-                ((*it >= 'A') && (*it <= 'Z'))
-                 )
-               || (
-                 (
-                   (lastChar == 'e') || (lastChar == 'E') ||
-                   (lastChar == 'f') || (lastChar == 'F') ||
-                   (lastChar == 'g') || (lastChar == 'G') ||
-                   (lastChar == 'h') || (lastChar == 'H') ||
-                   (lastChar == 'l') || (lastChar == 'L')
-                   ) && (
-                     (m_plusSigns.Contains(*it)) ||
-                     (m_minusSigns.Contains(*it))
-                     )
-                 )))
+      // Does the number contain an unicode plus or minus sign we need to replace?
+      bool unicodeSigns = false;
+      while (it < end)
       {
         wxChar ch = *it;
-        for (wxString::const_iterator it3 = m_plusSigns.begin(); it3 != m_plusSigns.end(); ++it3)
-          if(ch == *it3)
-            ch = '+';
-        for (wxString::const_iterator it3 = m_minusSigns.begin(); it3 != m_minusSigns.end(); ++it3)
-          if(ch == *it3)
-            ch = '-';
-        token += ch;
-        lastChar = *it;
+        unsigned char chClass = GetCharClass(ch);
+        if (!((chClass & CC_NUM) ||
+              ((ch >= 'a') && (ch <= 'z')) ||
+              ((ch >= 'A') && (ch <= 'Z')) ||
+              (((lastChar == 'e') || (lastChar == 'E') ||
+                (lastChar == 'f') || (lastChar == 'F') ||
+                (lastChar == 'g') || (lastChar == 'G') ||
+                (lastChar == 'h') || (lastChar == 'H') ||
+                (lastChar == 'l') || (lastChar == 'L')) &&
+               (chClass & (CC_PLUSSIGN | CC_MINUSSIGN)))))
+          break;
+        if ((chClass & (CC_PLUSSIGN | CC_MINUSSIGN)) && (ch != '+') && (ch != '-'))
+          unicodeSigns = true;
+        lastChar = ch;
         ++it;
       }
-      
-      m_tokens.emplace_back(token, TS_CODE_NUMBER);
+
+      wxString token(start, it);
+      if (unicodeSigns)
+      {
+        for (wxString::iterator it3 = token.begin(); it3 != token.end(); ++it3)
+        {
+          unsigned char chClass = GetCharClass(*it3);
+          if (chClass & CC_PLUSSIGN)
+            *it3 = '+';
+          else if (chClass & CC_MINUSSIGN)
+            *it3 = '-';
+        }
+      }
+      m_tokens.emplace_back(std::move(token), TS_CODE_NUMBER);
       continue;
     }
-    if (m_plusSigns.Contains(Ch))
+    if (charClass & CC_PLUSSIGN)
     {
-      wxString token = "+";
-      m_tokens.emplace_back(token);
+      m_tokens.emplace_back(wxString(wxT("+")));
+      ++it;
       continue;
     }
-    if (m_minusSigns.Contains(Ch))
+    if (charClass & CC_MINUSSIGN)
     {
-      wxString token = "-";
-      m_tokens.emplace_back(token);
+      m_tokens.emplace_back(wxString(wxT("-")));
+      ++it;
       continue;
     }
     // Merge consecutive spaces into one single token
-    if (IsSpace(Ch))
+    if (charClass & CC_SPACE)
     {
-      wxString token;
-      while ((it < commands.end()) && IsSpace(Ch))
+      // Are there spaces other than ' ' and '\t' we need to replace by a ' '?
+      bool otherSpaces = false;
+      while ((it < end) && (GetCharClass(*it) & CC_SPACE))
       {
-	if(Ch == '\t')
-          token += "\t";
-        else
-          token += " ";
-        if (++it < commands.end())
-          Ch = *it;
+        if ((*it != ' ') && (*it != '\t'))
+          otherSpaces = true;
+        ++it;
+      }
+      wxString token(start, it);
+      if (otherSpaces)
+      {
+        for (wxString::iterator it3 = token.begin(); it3 != token.end(); ++it3)
+          if (*it3 != '\t')
+            *it3 = ' ';
       }
-      m_tokens.emplace_back(token);
+      m_tokens.emplace_back(std::move(token));
       continue;
     }
     // Handle keywords
-    if (IsAlpha(Ch) || (Ch == '\\') || (Ch == '?'))
+    if ((charClass & CC_ALPHA) || (Ch == '\\') || (Ch == '?'))
     {
-      wxString token;
       if(Ch == '?')
-      {
-        token += Ch;
         ++it;
-        Ch = *it;
-      }
 
-      while ((it < commands.end()) && (IsAlphaNum(*it) || (*it == '\\')))
+      bool escapedNewline = false;
+      while ((it < end) && ((GetCharClass(*it) & (CC_ALPHA | CC_NUM)) || (*it == '\\')))
       {
-        Ch = *it;
-        token += Ch;
-        if (Ch == wxT('\\'))
+        if (*it == wxT('\\'))
         {
           ++it;
-          if (it < commands.end())
+          if (it < end)
           {
-            Ch = *it;
-            if (Ch != wxT('\n'))
-              token += Ch;
-            else
+            if (*it == wxT('\n'))
             {
-              m_tokens.emplace_back(token);
-              token = wxEmptyString;
-
+              escapedNewline = true;
               break;
             }
           }
         }
-        if(it < commands.end())
+        if(it < end)
           ++it;
       }
+      wxString token(start, it);
+      if (escapedNewline)
+      {
+        m_tokens.emplace_back(std::move(token));
+        continue;
+      }
+      
       if(token == ("to_lisp"))
       {
-        while((it < commands.end()) && ((!token.EndsWith("(to-maxima)"))) && ((!token.EndsWith(wxString("(to")+wxT("\u2212")+"maxima)"))))
+        while((it < end) && ((!token.EndsWith("(to-maxima)"))) && ((!token.EndsWith(wxString("(to")+wxT("\u2212")+"maxima)"))))
         {
           token += wxString(*it);
           ++it;
         }
-        m_tokens.emplace_back(token, TS_CODE_LISP);
+        m_tokens.emplace_back(std::move(token), TS_CODE_LISP);
       }
       else
       {
-        if (token == wxT("for") ||
-            token == wxT("in") ||
-            token == wxT("then") ||
-            token == wxT("while") ||
-            token == wxT("do") ||
-            token == wxT("thru") ||
-            token == wxT("next") ||
-            token == wxT("step") ||
-            token == wxT("unless") ||
-            token == wxT("from") ||
-            token == wxT("if") ||
-            token == wxT("else") ||
-            token == wxT("elif") ||
-            token == wxT("and") ||
-            token == wxT("or") ||
-            token == wxT("not") ||
-            token == wxT("not") ||
-            token == wxT("true") ||
-            token == wxT("false"))
-          m_tokens.emplace_back(token, TS_CODE_FUNCTION);
+        if (IsKeyword(token))
+          m_tokens.emplace_back(std::move(token), TS_CODE_FUNCTION);
         else
         {
           // Let's look what the next char looks like
           wxString::const_iterator it3(it);
-          while ((it3 < commands.end()) &&
+          while ((it3 < end) &&
                  ((*it3 == ' ') || (*it3 == '\t') || (*it3 == '\n') || (*it3 == '\r')))
             ++it3;
-          if(it3 >= commands.end())
-            m_tokens.emplace_back(token, TS_CODE_VARIABLE);
+          if((it3 < end) && (*it3 == '('))
+            m_tokens.emplace_back(std::move(token), TS_CODE_FUNCTION);
           else
-          {
-            if(*it3 == '(')
-              m_tokens.emplace_back(token, TS_CODE_FUNCTION);
-            else
-              m_tokens.emplace_back(token, TS_CODE_VARIABLE);
-          }
+            m_tokens.emplace_back(std::move(token), TS_CODE_VARIABLE);
         }
       }
       continue;
@@ -397,28 +458,67 @@ MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration
   }
 }
 
-bool MaximaTokenizer::IsAlpha(wxChar ch)
+bool MaximaTokenizer::IsKeyword(const wxString &token)
 {
-  if (wxIsalpha(ch))
-    return true;
+  static const std::unordered_set<wxString, wxStringHash, wxStringEqual> keywords = {
+    wxT("for"), wxT("in"), wxT("then"), wxT("while"), wxT("do"), wxT("thru"),
+    wxT("next"), wxT("step"), wxT("unless"), wxT("from"), wxT("if"), wxT("else"),
+    wxT("elif"), wxT("and"), wxT("or"), wxT("not"), wxT("true"), wxT("false")};
+  return keywords.find(token) != keywords.end();
+}
 
-  if(m_not_alphas.Find(ch) != wxNOT_FOUND)
-    return false;
-  
-  if(IsSpace(ch))
-    return false;
+unsigned char MaximaTokenizer::GetCharClass(wxChar ch)
+{
+  // Searching the char in all the lists of special chars for every char of a
+  // text is slow. Instead we look up the chars of the Basic Multilingual Plane
+  // in a table.
+  static const std::vector<unsigned char> charClasses = [](){
+    std::vector<unsigned char> classes(0x10000);
+    for (size_t i = 0; i < classes.size(); i++)
+      classes[i] = CalculateCharClass(wxChar(i));
+    return classes;
+  }();
+
+  if (static_cast<unsigned long>(ch) < charClasses.size())
+    return charClasses[static_cast<unsigned long>(ch)];
+  return CalculateCharClass(ch);
+}
+
+unsigned char MaximaTokenizer::CalculateCharClass(wxChar ch)
+{
+  unsigned char charClass = 0;
+  if (m_spaces.Find(ch) != wxNOT_FOUND)
+    charClass |= CC_SPACE;
+  if (m_linebreaks.Find(ch) != wxNOT_FOUND)
+    charClass |= CC_LINEBREAK;
+  if (m_operators.Find(ch) != wxNOT_FOUND)
+    charClass |= CC_OPERATOR;
+  if (m_plusSigns.Find(ch) != wxNOT_FOUND)
+    charClass |= CC_PLUSSIGN;
+  if (m_minusSigns.Find(ch) != wxNOT_FOUND)
+    charClass |= CC_MINUSSIGN;
+  if (m_unicodeNumbers.Find(ch) != wxNOT_FOUND)
+    charClass |= CC_UNICODENUMBER;
+  if ((ch >= '0') && (ch <= '9'))
+    charClass |= CC_NUM;
+
+  // If it cannot be converted to ascii and we didn't detect it as a char we know
+  // how to deal with it (in maxima's view) is an ordinary letter.
+  if (wxIsalpha(ch) ||
+      ((m_not_alphas.Find(ch) == wxNOT_FOUND) && !(charClass & CC_SPACE) &&
+       ((ch > 127) || (m_additional_alphas.Find(ch) != wxNOT_FOUND))))
+    charClass |= CC_ALPHA;
+  return charClass;
+}
 
-  // If it cannot be converted to asciiand we didn't detect it as a char we know how to deal with
-  // it (in maxima's view) is an ordinary letter.
-  if(ch > 127)
-    return true;
-  
-  return (m_additional_alphas.Find(ch) != wxNOT_FOUND);
+bool MaximaTokenizer::IsAlpha(wxChar ch)
+{
+  return GetCharClass(ch) & CC_ALPHA;
 }
 
 bool MaximaTokenizer::IsSpace(wxChar ch)
 {
-  return m_spaces.Find(ch) != wxNOT_FOUND;
+  return GetCharClass(ch) & CC_SPACE;
 }
 
 bool MaximaTokenizer::IsNum(wxChar ch)
@@ -428,7 +528,7 @@ bool MaximaTokenizer::IsNum(wxChar ch)
 
 bool MaximaTokenizer::IsAlphaNum(wxChar ch)
 {
-  return IsAlpha(ch) || IsNum(ch);
+  return GetCharClass(ch) & (CC_ALPHA | CC_NUM);
 }
 
 const wxString MaximaTokenizer::m_additional_alphas = wxT("\\_%µ");
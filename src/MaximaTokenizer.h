@@ -73,9 +73,81 @@ public:
   static const wxString &Operators() { return m_operators; }
 
   using TokenList = std::vector<Token>;
+  /*! Tokenizes commands, reusing the tokens of an earlier version of the text
+
+    Tokenizing restarts at the last line start in front of the first change
+    and stops as soon as a token starts at the same place in the unchanged
+    rest of the text as one of the old tokens did.
+
+    \param commands The text to tokenize
+    \param configuration The configuration
+    \param oldCommands The text oldTokens were made from
+    \param oldTokens The tokens of oldCommands. Are moved into the new token list.
+  */
+  MaximaTokenizer(wxString commands, Configuration *configuration,
+                  const wxString &oldCommands, TokenList &&oldTokens);
+
   TokenList PopTokens() && { return std::move(m_tokens); }
+  /*! How many tokens at the start of the token list are unchanged
+
+    The tokens the incremental constructor has taken over from the old token
+    list without tokenizing their text again. The last of them always is a
+    newline.
+  */
+  size_t GetUnchangedTokens() const { return m_unchangedTokens; }
   
 protected:
+  //! The classes of chars the tokenizer distinguishes. A char can be in several classes.
+  enum CharClass
+  {
+    CC_ALPHA = 1,
+    CC_NUM = 2,
+    CC_SPACE = 4,
+    CC_LINEBREAK = 8,
+    CC_OPERATOR = 16,
+    CC_PLUSSIGN = 32,
+    CC_MINUSSIGN = 64,
+    CC_UNICODENUMBER = 128
+  };
+  //! Returns the CharClass bits of a char, using a table for the Basic Multilingual Plane
+  static unsigned char GetCharClass(wxChar ch);
+  //! Determines the CharClass bits of a char from the lists of special chars
+  static unsigned char CalculateCharClass(wxChar ch);
+  //! Is this name a keyword like "for" or "then"?
+  static bool IsKeyword(const wxString &token);
+  //! What Resynchronize() needs to know about the old version of the text
+  struct Resync
+  {
+    explicit Resync(TokenList &oldTokens) : m_oldTokens(oldTokens) {}
+    TokenList &m_oldTokens;
+    //! The old token that is compared next
+    size_t m_oldToken = 0;
+    //! Where m_oldToken starts in the old text
+    size_t m_oldPos = 0;
+    //! Where the next new token starts in the new text
+    size_t m_newPos = 0;
+    //! The number of new tokens m_newPos includes
+    size_t m_countedTokens = 0;
+    //! The position in the new text behind the last changed char
+    size_t m_changeEnd = 0;
+    size_t m_oldLength = 0;
+    size_t m_newLength = 0;
+  };
+  //! Tokenizes commands, handling the lisp code at the start in lisp mode
+  void Tokenize(const wxString &commands, Configuration *configuration);
+  /*! Tokenizes commands, starting at it
+
+    If resync is given, stops tokenizing as soon as the old tokens can be reused.
+  */
+  void Tokenize(const wxString &commands, wxString::const_iterator it,
+                Configuration *configuration, Resync *resync = NULL);
+  /*! Appends the rest of the old tokens to m_tokens, if they are valid
+
+    \retval true if the tokens have been appended and tokenizing is done.
+  */
+  bool Resynchronize(Resync &resync);
+  //! The number of tokens at the start of m_tokens that haven't been tokenized again
+  size_t m_unchangedTokens = 0;
   //! The tokens the string is divided into
   TokenList m_tokens;
   //! ASCII symbols that wxIsalnum() doesn't see as chars, but maxima does.
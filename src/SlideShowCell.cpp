@@ -37,7 +37,6 @@
 #include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <wx/utils.h>
 #include <wx/clipbrd.h>
 #include <wx/config.h>
@@ -48,7 +47,7 @@
 // filesystem cannot be passed by const reference as we want to keep the
 // pointer to the file system alive in a background task
 // cppcheck-suppress performance symbolName=filesystem
-SlideShow::SlideShow(Cell *parent, Configuration **config, CellPointers *cellPointers, std::shared_ptr <wxFileSystem> filesystem, int framerate) :
+SlideShow::SlideShow(Cell *parent, Configuration **config, CellPointers *cellPointers, std::shared_ptr<ZipArchive> filesystem, int framerate) :
   Cell(parent, config, cellPointers),
   m_timer(NULL),
   m_fileSystem(filesystem)
@@ -366,9 +365,6 @@ void SlideShow::Draw(wxPoint point)
              imageBorderWidth - m_imageBorderWidth, imageBorderWidth - m_imageBorderWidth);
 
   }
-  else
-    // The cell isn't drawn => No need to keep it's image cache for now.
-    ClearCache();
 
   // If we need a selection border on another redraw we will be informed by OnPaint() again.
   m_drawBoundingBox = false;
@@ -398,7 +394,7 @@ wxString SlideShow::ToXML()
   for (int i = 0; i < m_size; i++)
   {
     wxString basename = m_cellPointers->WXMXGetNewFileName();
-    // add the file to memory
+    // schedule the files to be stored in the .wxmx file
     if (m_images[i])
     {
       // Anonymize the name of our temp directory for saving
@@ -419,33 +415,17 @@ wxString SlideShow::ToXML()
       if(gnuplotSource != wxEmptyString)
       {
         gnuplotSourceFiles += gnuplotSource + ";";
-        wxMemoryBuffer data = m_images[i]->GetGnuplotSource();
-        if(data.GetDataLen() > 0)
-        {
-          wxMemoryFSHandler::AddFile(gnuplotSource,
-                                     data.GetData(),
-                                     data.GetDataLen()
-            );
-        }
+        m_cellPointers->WXMXAddGnuplotFile(gnuplotSource, m_images[i], false);
       }
       if(gnuplotData != wxEmptyString)
       {
         gnuplotDataFiles += gnuplotData + ";";
-        wxMemoryBuffer data = m_images[i]->GetGnuplotData();
-        if(data.GetDataLen() > 0)
-        {
-          wxMemoryFSHandler::AddFile(gnuplotData,
-                                     data.GetData(),
-                                     data.GetDataLen()
-            );
-        }
+        m_cellPointers->WXMXAddGnuplotFile(gnuplotData, m_images[i], true);
       }
       
       if (m_images[i]->GetCompressedImage())
-        wxMemoryFSHandler::AddFile(basename + m_images[i]->GetExtension(),
-                                   m_images[i]->GetCompressedImage().GetData(),
-                                   m_images[i]->GetCompressedImage().GetDataLen()
-        );
+        m_cellPointers->WXMXAddFile(basename + m_images[i]->GetExtension(),
+                                    m_images[i]->GetCompressedImage());
     }
 
     images += basename + m_images[i]->GetExtension() + wxT(";");
@@ -533,7 +513,7 @@ wxString SlideShow::GetToolTip(const wxPoint &point)
                "One example of the latter would be: Gnuplot refuses to plot entirely "
                "empty images"));
     else
-      return m_toolTip;
+      return GetLocalToolTip();
   }
   else
     return wxEmptyString;
@@ -579,6 +559,12 @@ void SlideShow::ClearCache()
       m_images[i]->ClearCache();
 }
 
+void SlideShow::PrefetchImage()
+{
+  if ((m_displayed >= 0) && (m_displayed < m_size) && (m_images[m_displayed] != NULL))
+    m_images[m_displayed]->PrefetchBitmap();
+}
+
 SlideShow::GifDataObject::GifDataObject(const wxMemoryOutputStream &str) : wxCustomDataObject(m_gifFormat)
 {
   SetData(str.GetOutputStreamBuffer()->GetBufferSize(),
@@ -35,7 +35,7 @@
 #include <wx/timer.h>
 
 #include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "ZipArchive.h"
 #include <wx/mstream.h>
 #include <wx/wfstream.h>
 
@@ -51,13 +51,13 @@ public:
     has to be set to -1.
     \param config A pointer to the pointer to the configuration storage of the 
                   worksheet this cell belongs to.
-    \param filesystem The filesystem the contents of this slideshow can be found in.
+    \param filesystem The .wxmx archive the contents of this slideshow can be found in.
                       NULL = the operating system's filesystem
     \param parent     The parent GroupCell this cell belongs to.
     \param cellPointers All pointers that might point to this cell and that need to
                         be set to NULL if this cell is deleted.
    */
-  SlideShow(Cell *parent, Configuration **config, CellPointers *cellPointers, std::shared_ptr<wxFileSystem> filesystem, int framerate = -1);
+  SlideShow(Cell *parent, Configuration **config, CellPointers *cellPointers, std::shared_ptr<ZipArchive> filesystem, int framerate = -1);
   SlideShow(Cell *parent, Configuration **config, CellPointers *cellPointers, int framerate = -1);
   SlideShow(const SlideShow &cell);
   //! A constructor that loads the compressed file from a wxMemoryBuffer
@@ -100,6 +100,9 @@ public:
    */
   virtual void ClearCache() override;
 
+  //! Starts decoding the image that is currently displayed in the background
+  virtual void PrefetchImage() override;
+
   void LoadImages(wxArrayString images, bool deleteRead);
 
   int GetDisplayedIndex() const
@@ -157,7 +160,7 @@ public:
       return (!m_images[m_displayed]->GnuplotSource().IsEmpty());
     }
 
-  void GnuplotSource(int image, wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<wxFileSystem> filesystem)
+  void GnuplotSource(int image, wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<ZipArchive> filesystem)
     {
       m_images[image]->GnuplotSource(gnuplotFilename, dataFilename, filesystem);
     }
@@ -194,7 +197,7 @@ protected:
   bool m_animationRunning;
   int m_size;
   int m_displayed;
-  std::shared_ptr<wxFileSystem> m_fileSystem;
+  std::shared_ptr<ZipArchive> m_fileSystem;
   std::vector<std::shared_ptr<Image>> m_images;
 
   void RecalculateHeight(int fontsize) override;
@@ -27,6 +27,7 @@
 #include "StatusBar.h"
 #include <wx/artprov.h>
 #include <wx/display.h>
+#include <wx/time.h>
 #include "../art/statusbar/images.h"
 #include "SvgBitmap.h"
 #include <wx/mstream.h>
@@ -42,6 +43,9 @@ StatusBar::StatusBar(wxWindow *parent, int id) : wxStatusBar(parent, id),
   int widths[] = {-1, 300, GetSize().GetHeight()};
   m_maximaPercentage = -1;
   m_oldmaximaPercentage = -1;
+  m_transferStart = m_lastReceive = wxGetLocalTimeMillis();
+  m_bytesInTransfer = 0;
+  m_bytesPerSecond = 0;
   SetFieldsCount(3, widths);
   m_stdToolTip = _(
           "Maxima, the program that does the actual mathematics is started as a separate process. This has the advantage that an eventual crash of maxima cannot harm wxMaxima, which displays the worksheet.\nThis icon indicates if data is transferred between maxima and wxMaxima.");
@@ -183,7 +187,7 @@ void StatusBar::NetworkStatus(networkState status)
         m_networkStatus->SetBitmap(m_network_idle_inactive);
       
       m_networkState = status;
-      wxString toolTip = m_stdToolTip;
+      wxString toolTip = StdToolTip();
       if(m_maximaPercentage >= 0)
         toolTip +=wxString::Format(
           _("\n\nMaxima is currently using %3.3f%% of all available CPUs."),
@@ -207,7 +211,7 @@ void StatusBar::NetworkStatus(networkState status)
       ReceiveTimer.StartOnce(200);
       HandleTimerEvent();
       if((m_oldmaximaPercentage >= 0) &&(m_maximaPercentage < 0))
-        m_networkStatus->SetToolTip(m_stdToolTip);
+        m_networkStatus->SetToolTip(StdToolTip());
     }
     break;
     case transmit:
@@ -224,6 +228,35 @@ void StatusBar::NetworkStatus(networkState status)
   }
 }
 
+void StatusBar::BytesFromMaxima(long bytes)
+{
+  wxLongLong now = wxGetLocalTimeMillis();
+  // If we didn't receive anything for a second this is the start of a new transfer
+  if(now - m_lastReceive > 1000)
+  {
+    m_transferStart = now;
+    m_bytesInTransfer = 0;
+  }
+  m_lastReceive = now;
+  m_bytesInTransfer += bytes;
+  wxLongLong millis = now - m_transferStart;
+  // Don't calculate a rate for transfers that are too short to be measured
+  if(millis < 100)
+    return;
+  m_bytesPerSecond = (m_bytesInTransfer * 1000 / millis).ToLong();
+  if((m_networkState != error) && (m_networkState != offline))
+    m_networkStatus->SetToolTip(StdToolTip());
+}
+
+wxString StatusBar::StdToolTip()
+{
+  if(m_bytesPerSecond <= 0)
+    return m_stdToolTip;
+  return m_stdToolTip + wxString::Format(
+    _("\n\nData from maxima arrived at %li bytes/s during the last transfer."),
+    m_bytesPerSecond);
+}
+
 void StatusBar::OnSize(wxSizeEvent &event)
 {
   wxRect rect;
@@ -58,6 +58,16 @@ public:
   //! Informs the status bar about networking events.
   void NetworkStatus(networkState status);
 
+  /*! Informs the status bar how many bytes we just have read from maxima
+
+    Is used for calculating the transfer rate shown in the network icon's tooltip.
+   */
+  void BytesFromMaxima(long bytes);
+
+  //! The rate maxima's output was received with during the last transfer [bytes/s]
+  long GetBytesPerSecond() const
+    { return m_bytesPerSecond; }
+
   wxStaticBitmap *GetNetworkStatusElement()
   { return m_networkStatus; }
 
@@ -88,6 +98,16 @@ private:
    */
   float m_oldmaximaPercentage;
   networkState m_oldNetworkState;
+  //! When did the current transfer from maxima start?
+  wxLongLong m_transferStart;
+  //! When did we read the last bytes from maxima?
+  wxLongLong m_lastReceive;
+  //! How many bytes have we read since m_transferStart?
+  wxLongLong m_bytesInTransfer;
+  //! The rate the data of the current or last transfer arrived with [bytes/s]
+  long m_bytesPerSecond;
+  //! The tooltip for the network icon, including the info about the transfer rate
+  wxString StdToolTip();
   wxString m_stdToolTip;
   wxString m_networkErrToolTip;
   wxString m_noConnectionToolTip;
@@ -112,8 +112,8 @@ void SubCell::Draw(wxPoint point)
 
 wxString SubCell::ToString()
 {
-  if (m_altCopyText != wxEmptyString)
-    return m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+    return GetAltCopyText();
 
   wxString s;
   if (m_baseCell->IsCompound())
@@ -126,9 +126,9 @@ wxString SubCell::ToString()
 
 wxString SubCell::ToMatlab()
 {
-  if (m_altCopyText != wxEmptyString)
+  if (GetAltCopyText() != wxEmptyString)
   {
-	return m_altCopyText;
+	return GetAltCopyText();
   }
 
   wxString s;
@@ -176,8 +176,8 @@ wxString SubCell::ToXML()
   if (m_forceBreakLine)
     flags += wxT(" breakline=\"true\"");
 
-  if (m_altCopyText != wxEmptyString)
-    flags += wxT(" altCopy=\"") + XMLescape(m_altCopyText) + wxT("\"");
+  if (GetAltCopyText() != wxEmptyString)
+    flags += wxT(" altCopy=\"") + XMLescape(GetAltCopyText()) + wxT("\"");
   
   return wxT("<i") + flags + wxT("><r>") + m_baseCell->ListToXML() + wxT("</r><r>") +
            m_indexCell->ListToXML() + wxT("</r></i>");
@@ -255,8 +255,8 @@ void SubSupCell::Draw(wxPoint point)
 
 wxString SubSupCell::ToString()
 {
-  if (m_altCopyText != wxEmptyString)
-    return m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+    return GetAltCopyText();
 
   wxString s;
   if (m_baseCell->IsCompound())
@@ -450,8 +450,8 @@ wxString SubSupCell::ToXML()
   if (m_forceBreakLine)
     flags += " breakline=\"true\"";
 
-  if (m_altCopyText != wxEmptyString)
-    flags += " altCopy=\"" + XMLescape(m_altCopyText) + "\"";
+  if (GetAltCopyText() != wxEmptyString)
+    flags += " altCopy=\"" + XMLescape(GetAltCopyText()) + "\"";
 
   wxString retval;
   if (m_scriptCells.empty())
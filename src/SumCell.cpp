@@ -268,8 +268,8 @@ void SumCell::Draw(wxPoint point)
 
 wxString SumCell::ToString()
 {
-  if (m_altCopyText != wxEmptyString)
-    return m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+    return GetAltCopyText();
 
   wxString s;
   if (m_sumStyle == SM_SUM)
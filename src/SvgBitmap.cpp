@@ -155,4 +155,26 @@ wxBitmap SvgBitmap::RGBA2wxBitmap(const unsigned char imgdata[],
   return retval;
 }
 
+wxImage SvgBitmap::RGBA2wxImage(const unsigned char imgdata[],
+                                const int &width, const int &height)
+{
+  wxImage retval(width, height, false);
+  if(!retval.Ok())
+    return retval;
+  retval.SetAlpha();
+
+  const unsigned char* rgba = imgdata;
+  unsigned char *rgb = retval.GetData();
+  unsigned char *alpha = retval.GetAlpha();
+  for(int i = 0; i < width * height; i++)
+  {
+    *rgb++ = rgba[0];
+    *rgb++ = rgba[1];
+    *rgb++ = rgba[2];
+    *alpha++ = rgba[3];
+    rgba += 4;
+  }
+  return retval;
+}
+
 struct NSVGrasterizer* SvgBitmap::m_svgRast = NULL;
@@ -31,6 +31,7 @@
 #include "Cell.h"
 
 #include <wx/bitmap.h>
+#include <wx/image.h>
 #include "nanoSVG/nanosvg.h"
 #include "nanoSVG/nanosvgrast.h"
 
@@ -46,6 +47,11 @@ public:
   
   //! Converts rgba data to a wxBitmap
   static wxBitmap RGBA2wxBitmap(const unsigned char imgdata[],const int &width, const int &height);
+  /*! Converts rgba data to a wxImage
+
+    Unlike RGBA2wxBitmap() this function can be called from a background task.
+   */
+  static wxImage RGBA2wxImage(const unsigned char imgdata[],const int &width, const int &height);
   //! Sets the bitmap to a new size and renders the svg image at this size.
   const SvgBitmap& SetSize(int width, int height);
   //! Sets the bitmap to a new size and renders the svg image at this size.
@@ -29,6 +29,7 @@
 
 #include "TextCell.h"
 #include "FontCache.h"
+#include "TextExtentCache.h"
 #include "wx/config.h"
 
 TextCell::TextCell(Cell *parent, Configuration **config, CellPointers *cellPointers,
@@ -388,7 +389,7 @@ wxSize TextCell::GetTextSize(wxString const &text)
 
   // Ask wxWidgets to return this text piece's size (slow, but the only way if
   // there is no cached size).
-  wxSize sz = dc->GetTextExtent(text);
+  wxSize sz = TextExtentCache::GetATextExtent(dc, text);
   m_widths[fontSize] = sz;
   return sz;
 }
@@ -461,7 +462,7 @@ void TextCell::RecalculateWidths(int fontsize)
           m_numStartWidth = it->second;
         else
         {
-          wxSize sz = dc->GetTextExtent(m_numStart);
+          wxSize sz = TextExtentCache::GetATextExtent(dc, m_numStart);
           m_numstartWidths[fontSize] = sz;
           m_numStartWidth = sz;
         }
@@ -472,7 +473,7 @@ void TextCell::RecalculateWidths(int fontsize)
           m_numEndWidth = it->second;
         else
         {
-          wxSize sz = dc->GetTextExtent(m_numEnd);
+          wxSize sz = TextExtentCache::GetATextExtent(dc, m_numEnd);
           m_numEndWidths[fontSize] = sz;
           m_numEndWidth = sz;
         }
@@ -483,7 +484,7 @@ void TextCell::RecalculateWidths(int fontsize)
           m_ellipsisWidth = it->second;
         else
         {
-          wxSize sz = dc->GetTextExtent(m_ellipsis);
+          wxSize sz = TextExtentCache::GetATextExtent(dc, m_ellipsis);
           m_ellipsisWidths[fontSize] = sz;
           m_ellipsisWidth = sz;
         }
@@ -793,8 +794,8 @@ bool TextCell::IsOperator() const
 wxString TextCell::ToString()
 {
   wxString text;
-  if (m_altCopyText != wxEmptyString)
-    text = m_altCopyText;
+  if (GetAltCopyText() != wxEmptyString)
+    text = GetAltCopyText();
   else
   {
     text = m_text;
@@ -869,8 +870,8 @@ wxString TextCell::ToString()
 wxString TextCell::ToMatlab()
 {
 	wxString text;
-	if (m_altCopyText != wxEmptyString)
-	  text = m_altCopyText;
+	if (GetAltCopyText() != wxEmptyString)
+	  text = GetAltCopyText();
 	else
 	{
 	  text = m_text;
@@ -1587,11 +1588,11 @@ wxString TextCell::ToXML()
   if(m_userDefinedLabel != wxEmptyString)
     flags += wxT(" userdefinedlabel=\"") + XMLescape(m_userDefinedLabel) + wxT("\"");
 
-  if(m_altCopyText != wxEmptyString)
-    flags += wxT(" altCopy=\"") + XMLescape(m_altCopyText) + wxT("\"");
+  if(GetAltCopyText() != wxEmptyString)
+    flags += wxT(" altCopy=\"") + XMLescape(GetAltCopyText()) + wxT("\"");
 
-  if(m_toolTip != wxEmptyString)
-    flags += wxT(" tooltip=\"") + XMLescape(m_toolTip) + wxT("\"");
+  if(GetLocalToolTip() != wxEmptyString)
+    flags += wxT(" tooltip=\"") + XMLescape(GetLocalToolTip()) + wxT("\"");
 
   return wxT("<") + tag + flags + wxT(">") + xmlstring + wxT("</") + tag + wxT(">");
 }
@@ -0,0 +1,107 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file defines the class TextExtentCache that remembers the size of text
+  snippets that have been measured before.
+ */
+
+#include "TextExtentCache.h"
+#include <wx/hashmap.h>
+#include <wx/log.h>
+#include <functional>
+
+TextExtentCache::TextExtentCache()
+{
+  m_index.reserve(MaxEntries);
+}
+
+TextExtentCache::~TextExtentCache()
+{
+  wxLogMessage("~TextExtentCache: hits=%d misses=%d h:m ratio=%.2f",
+               m_hits, m_misses, double(m_hits)/m_misses);
+}
+
+std::size_t TextExtentCache::KeyHash::operator()(const Key &key) const
+{
+  std::size_t h = wxStringHash()(key.m_text);
+  h ^= std::hash<int>()(key.m_font) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  h ^= std::hash<int>()(key.m_ppi.x) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  h ^= std::hash<double>()(key.m_scale) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  return h;
+}
+
+int TextExtentCache::FontId(const wxFont &font)
+{
+  if ((m_lastFontId >= 0) && m_lastFont.IsOk() &&
+      (font.GetRefData() == m_lastFont.GetRefData()))
+    return m_lastFontId;
+
+  auto id = m_fontIds.emplace(FontInfo::GetFor(font), int(m_fontIds.size()));
+  m_lastFont = font;
+  m_lastFontId = id.first->second;
+  return m_lastFontId;
+}
+
+wxSize TextExtentCache::GetTextExtent(wxDC *dc, const wxString &text)
+{
+  if (!m_enabled)
+  {
+    m_misses++;
+    return dc->GetTextExtent(text);
+  }
+
+  double scaleX, scaleY;
+  dc->GetUserScale(&scaleX, &scaleY);
+  Key key = {FontId(dc->GetFont()), dc->GetPPI(), scaleX, text};
+
+  auto entry = m_index.find(key);
+  if (entry != m_index.end())
+  {
+    m_hits++;
+    // Mark the entry as the one that has been used most recently
+    m_entries.splice(m_entries.begin(), m_entries, entry->second);
+    return entry->second->second;
+  }
+
+  m_misses++;
+  wxSize size = dc->GetTextExtent(text);
+  if (m_entries.size() >= MaxEntries)
+  {
+    m_index.erase(m_entries.back().first);
+    m_entries.pop_back();
+  }
+  m_entries.emplace_front(key, size);
+  m_index.emplace(std::move(key), m_entries.begin());
+  return size;
+}
+
+void TextExtentCache::Clear()
+{
+  m_index.clear();
+  m_entries.clear();
+  m_fontIds.clear();
+  m_lastFont = wxNullFont;
+  m_lastFontId = -1;
+  m_hits = 0;
+  m_misses = 0;
+}
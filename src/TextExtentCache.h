@@ -0,0 +1,125 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file declares the class TextExtentCache that remembers the size of text
+  snippets that have been measured before.
+ */
+
+#ifndef TEXTEXTENTCACHE_H
+#define TEXTEXTENTCACHE_H
+
+#include <wx/dc.h>
+#include <wx/font.h>
+#include <wx/string.h>
+#include <list>
+#include <unordered_map>
+#include "FontCache.h"
+
+/*! A process-wide cache for the size of text snippets
+
+  Asking wxWidgets for the size of a text snippet is slow. But the same snippets
+  (variable names like x, operators or labels like (%o12)) appear in many cells
+  and need to be measured again every time a cell has dropped its own size cache.
+  This cache remembers the size of a text snippet for each font it was measured
+  in. The font is identified by its wxFontInfo, as FontCache does. As the size of
+  a text also depends on the resolution and the scale of the DC, both are part of
+  the key, too.
+
+  The cache holds at most a fixed number of entries: If it is full the entry
+  that has been used least recently is dropped.
+*/
+class TextExtentCache final
+{
+  TextExtentCache(const TextExtentCache &) = delete;
+  TextExtentCache &operator=(const TextExtentCache &) = delete;
+public:
+  //! The number of text sizes the cache remembers at most
+  static constexpr size_t MaxEntries = 30000;
+
+  TextExtentCache();
+  ~TextExtentCache();
+  //! Returns the size of text in the font that currently is selected in dc
+  wxSize GetTextExtent(wxDC *dc, const wxString &text);
+  int GetHits() const { return m_hits; }
+  int GetMisses() const { return m_misses; }
+  void SetEnabled(bool enabled = true) { m_enabled = enabled; }
+  void Clear();
+  static TextExtentCache &Get()
+  {
+    static TextExtentCache globalCache;
+    return globalCache;
+  }
+  static wxSize GetATextExtent(wxDC *dc, const wxString &text)
+  {
+    return Get().GetTextExtent(dc, text);
+  }
+
+private:
+  //! What a text size depends on
+  struct Key
+  {
+    //! The number FontId() has assigned to the font
+    int m_font;
+    //! The resolution of the DC
+    wxSize m_ppi;
+    //! The user scale of the DC
+    double m_scale;
+    //! The text that is measured
+    wxString m_text;
+    bool operator==(const Key &key) const
+      {
+        return (m_font == key.m_font) && (m_ppi == key.m_ppi) &&
+          (m_scale == key.m_scale) && (m_text == key.m_text);
+      }
+  };
+  struct KeyHash
+  {
+    std::size_t operator()(const Key &key) const;
+  };
+  typedef std::list<std::pair<Key, wxSize>> EntryList;
+
+  /*! Returns a number that identifies the font
+
+    Converting a wxFont to a wxFontInfo is not exactly cheap. As most text
+    snippets are measured in the same font as the one before the font that was
+    converted last is remembered: We hold a reference to it which means that its
+    data cannot be freed and reused by another font while we compare to it.
+  */
+  int FontId(const wxFont &font);
+
+  //! The entries, the entry that has been used most recently first
+  EntryList m_entries;
+  //! Where in m_entries the entry for each key is stored
+  std::unordered_map<Key, EntryList::iterator, KeyHash> m_index;
+  //! The numbers we have assigned to fonts
+  std::unordered_map<wxFontInfo, int> m_fontIds;
+  //! The font FontId() has been asked for last
+  wxFont m_lastFont;
+  //! The number of m_lastFont
+  int m_lastFontId = -1;
+  bool m_enabled = true;
+  int m_hits = 0;
+  int m_misses = 0;
+};
+
+#endif // TEXTEXTENTCACHE_H
@@ -37,12 +37,13 @@
 #include "EMFout.h"
 #include "WXMformat.h"
 #include "Version.h"
-#include "levenshtein/levenshtein.h"
+#include "BitmapCache.h"
 #include <wx/richtext/richtextbuffer.h>
 #include <wx/tooltip.h>
 #include <wx/dcbuffer.h>
 #include <wx/wupdlock.h>
 #include <wx/event.h>
+#include <wx/time.h>
 #include "wxMaximaFrame.h"
 #include "Worksheet.h"
 #include "BitmapOut.h"
@@ -66,7 +67,6 @@
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
 #include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <stdlib.h>
 #include "memory"
 
@@ -142,6 +142,8 @@ Worksheet::Worksheet(wxWindow *parent, int id, Worksheet* &observer, wxPoint pos
   m_windowActive = true;
   m_lastTop = 0;
   m_lastBottom = 0;
+  m_prefetchesDone = 0;
+  m_outputPendingSince = 0;
   m_followEvaluation = true;
   TreeUndo_ActiveCell = NULL;
   m_questionPrompt = false;
@@ -241,6 +243,18 @@ bool Worksheet::RedrawIfRequested()
 
   RecalculateIfNeeded();
 
+  // Redraw the cells that have been drawn with a placeholder if a background
+  // task has finished rendering an image since. Cells whose image still isn't
+  // ready will just add themselves to the list again.
+  if (!m_cellPointers.m_cellsWaitingForImage.empty() &&
+      (m_prefetchesDone != BitmapCache::Get().GetPrefetchesDone()))
+  {
+    m_prefetchesDone = BitmapCache::Get().GetPrefetchesDone();
+    for (auto it : m_cellPointers.m_cellsWaitingForImage)
+      RequestRedraw(static_cast<Cell *>(it.first)->GetRect());
+    m_cellPointers.m_cellsWaitingForImage.clear();
+  }
+
   if(m_mouseMotionWas)
   {
     if ((m_cellPointers.m_groupCellUnderPointer == NULL) ||
@@ -251,16 +265,7 @@ bool Worksheet::RedrawIfRequested()
       GroupCell *oldGroupCellUnderPointer = dynamic_cast<GroupCell *>(m_cellPointers.m_groupCellUnderPointer);
 
       // find out which group cell lies under the pointer
-      GroupCell *tmp = GetTree();
-      wxRect rect;
-
-      while (tmp != NULL)
-      {
-        rect = tmp->GetRect();
-        if (m_pointer_y <= rect.GetBottom())
-          break;
-        tmp = tmp->GetNext();
-      }
+      GroupCell *tmp = GroupCellEndingBelow(m_pointer_y);
       if (GetTree())
         GetTree()->CellUnderPointer(tmp);
 
@@ -442,6 +447,7 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
   m_configuration->SetBackgroundBrush(
     *(wxTheBrushList->FindOrCreateBrush(m_configuration->DefaultBackgroundColor(),
                                         wxBRUSHSTYLE_SOLID)));
+  FlushPendingOutput();
   wxAutoBufferedPaintDC dc(this);
   if(!dc.IsOk())
     return;
@@ -624,11 +630,49 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
   //
   // Draw the cell contents
   //
+  int width;
+  int height;
+  GetClientSize(&width, &height);
+
+  wxPoint upperLeftScreenCorner;
+  CalcScrolledPosition(0, 0,
+                       &upperLeftScreenCorner.x, &upperLeftScreenCorner.y);
+  (m_configuration)->SetVisibleRegion(wxRect(upperLeftScreenCorner,
+                                             upperLeftScreenCorner + wxPoint(width,height)));
+  (m_configuration)->SetWorksheetPosition(GetPosition());
+
+  // Start decoding the images of the cells that are less than a screen's height
+  // above or below the visible part of the worksheet so they are ready when we
+  // scroll to them. The memory the decoded images need is limited by the
+  // BitmapCache, which also drops the images that have been shown longest ago.
+  {
+    int viewLeft, viewTop;
+    CalcUnscrolledPosition(0, 0, &viewLeft, &viewTop);
+    int viewBottom = viewTop + height;
+    GroupCell *tmp = GroupCellEndingBelow(viewTop - height);
+    while ((tmp != NULL) && (tmp->GetRect().GetTop() <= viewBottom + height))
+    {
+      wxRect cellRect = tmp->GetRect();
+      if (((cellRect.GetBottom() < viewTop) || (cellRect.GetTop() > viewBottom)) &&
+          !tmp->SizeIsEstimated() && tmp->GetOutput())
+        tmp->GetOutput()->PrefetchImageList();
+      tmp = tmp->GetNext();
+    }
+  }
+
+  // Only the cells that touch the update region need to be drawn.
+  GroupCell *tmp = GroupCellEndingBelow(top);
   wxPoint point;
-  point.x = m_configuration->GetIndent();
-  point.y = m_configuration->GetBaseIndent() + GetTree()->GetCenterList();
-  // Draw tree
-  GroupCell *tmp = GetTree();
+  if(tmp == GetTree())
+  {
+    point.x = m_configuration->GetIndent();
+    point.y = m_configuration->GetBaseIndent() + GetTree()->GetCenterList();
+  }
+  else if(tmp != NULL)
+  {
+    tmp->UpdateYPosition();
+    point = tmp->GetCurrentPoint();
+  }
   
   m_configuration->GetDC()->SetPen(*(wxThePenList->FindOrCreatePen(m_configuration->GetColor(TS_DEFAULT), 1, wxPENSTYLE_SOLID)));
   m_configuration->GetDC()->SetBrush(*(wxTheBrushList->FindOrCreateBrush(m_configuration->GetColor(TS_DEFAULT))));
@@ -647,33 +691,16 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
       tmp->Recalculate();
       recalculateNecessaryWas = true;
     }
-    
-    wxRect cellRect = tmp->GetRect();
-    
-    int width;
-    int height;
-    GetClientSize(&width, &height);
-    
-    wxPoint upperLeftScreenCorner;
-    CalcScrolledPosition(0, 0,
-                         &upperLeftScreenCorner.x, &upperLeftScreenCorner.y);
-    (m_configuration)->SetVisibleRegion(wxRect(upperLeftScreenCorner,
-                                               upperLeftScreenCorner + wxPoint(width,height)));
-    (m_configuration)->SetWorksheetPosition(GetPosition());
-    // Clear the image cache of all cells above or below the viewport.
-    if ((cellRect.GetTop() >= bottom) || (cellRect.GetBottom() <= top))
-    {
-      // Only actually clear the image cache if there is a screen's height between
-      // us and the image's position: Else the chance is too high that we will
-      // very soon have to generated a scaled image again.
-      if ((cellRect.GetBottom() <= m_lastBottom - 2 * height) || (cellRect.GetTop() >= m_lastTop + 2 * height))
-      {
-        if (tmp->GetOutput())
-          tmp->GetOutput()->ClearCacheList();
-      }
+    // Cells we have scrolled to before the idle loop could lay them out
+    if(tmp->SizeIsEstimated())
+    {
+      tmp->Recalculate();
+      Recalculate(tmp);
     }
-    
+
     tmp->SetCurrentPoint(point);
+    if(tmp->GetRect().GetTop() > bottom)
+      break;
     if (tmp->DrawThisCell(point))
     {
       tmp->InEvaluationQueue(m_evaluationQueue.IsInQueue(tmp));
@@ -889,10 +916,28 @@ void Worksheet::InsertLine(Cell *newCell, bool forceNewLine)
     return;
 
   newCell->ForceBreakLine(forceNewLine);
-  newCell->SetGroupList(tmp);
-  
-  tmp->AppendOutput(newCell);
-  
+
+  if (m_cellPointers.m_groupWithPendingOutput != tmp)
+  {
+    FlushPendingOutput();
+    m_cellPointers.m_groupWithPendingOutput = tmp;
+    m_outputPendingSince = wxGetLocalTimeMillis();
+  }
+  // AppendOutput() assigns newCell to its GroupCell.
+  tmp->AppendOutput(newCell, false);
+
+  if (wxGetLocalTimeMillis() - m_outputPendingSince > MaxOutputLatency)
+    FlushPendingOutput();
+}
+
+void Worksheet::FlushPendingOutput()
+{
+  GroupCell *tmp = dynamic_cast<GroupCell *>(m_cellPointers.m_groupWithPendingOutput);
+  if (tmp == NULL)
+    return;
+  m_cellPointers.m_groupWithPendingOutput = NULL;
+
+  tmp->OutputAppended();
   UpdateConfigurationClientSize();
   if(tmp->m_next == NULL)
     UpdateMLast();
@@ -958,8 +1003,13 @@ void Worksheet::SetZoomFactor(double newzoom, bool recalc)
 
 bool Worksheet::RecalculateIfNeeded()
 {
+  FlushPendingOutput();
   bool recalculate = true;
   UpdateConfigurationClientSize();
+  // Cells whose size we only have estimated need to be recalculated as soon as
+  // they are scrolled near the visible part of the worksheet.
+  if((m_recalculateStart == NULL) && (GetTree() != NULL))
+    m_recalculateStart = FirstEstimatedCellNearViewport();
   if((m_recalculateStart == NULL) || (GetTree() == NULL))
     recalculate = false;
 
@@ -996,9 +1046,28 @@ bool Worksheet::RecalculateIfNeeded()
                                            upperLeftScreenCorner + wxPoint(width,height)));
   m_configuration->SetWorksheetPosition(GetPosition());
 
+  // Only the cells near the visible part of the worksheet are laid out: The
+  // size of all other cells is only estimated until they are scrolled into view.
+  // Printing and exporting need the real size of all cells.
+  bool layoutAll = (m_configuration->GetPrinting()) || (!m_configuration->ClipToDrawRegion());
+  wxPoint topLeft;
+  CalcUnscrolledPosition(0, 0, &topLeft.x, &topLeft.y);
+  int layoutTop = topLeft.y - height;
+  int layoutBottom = topLeft.y + 2 * height;
+
   while (tmp != NULL)
   {
-    tmp->Recalculate();
+    if(layoutAll)
+      tmp->Recalculate();
+    else
+    {
+      tmp->UpdateYPosition();
+      wxRect rect = tmp->GetRect();
+      if((rect.GetBottom() >= layoutTop) && (rect.GetTop() <= layoutBottom))
+        tmp->Recalculate();
+      else
+        tmp->EstimateSize();
+    }
     tmp = tmp->GetNext();
   }
 
@@ -1435,7 +1504,10 @@ void Worksheet::OnMouseRightDown(wxMouseEvent &event)
       if (IsSelected(MC_TYPE_DEFAULT))
       {
         wxString wordUnderCursor = GetSelectionStart()->ToString();
-        if(m_helpFileAnchorsUsable &&(!m_helpFileAnchors[wordUnderCursor].IsEmpty()))
+        // The anchors may still be compiled in the background: Only their
+        // index is safe to use here.
+        std::shared_ptr<const FuzzyWordIndex> helpFileAnchors = GetHelpFileAnchorsIndex();
+        if(helpFileAnchors && helpFileAnchors->Contains(wordUnderCursor))
         {          
           popupMenu->Append(wxID_HELP, wxString::Format(_("Help on \"%s\""), wordUnderCursor));
           popupMenu->AppendSeparator();
@@ -1727,25 +1799,40 @@ void Worksheet::OnMouseRightDown(wxMouseEvent &event)
             wxString wordUnderCursor = group->GetEditable()->GetWordUnderCaret();
             wxArrayString dst[4];
             wxArrayString sameBeginning;
-            if(m_helpFileAnchorsUsable &&(!m_helpFileAnchors[wordUnderCursor].IsEmpty()))
+            // The anchors may still be compiled in the background: Only their
+            // index is safe to use here.
+            std::shared_ptr<const FuzzyWordIndex> helpFileAnchors = GetHelpFileAnchorsIndex();
+            if(helpFileAnchors && helpFileAnchors->Contains(wordUnderCursor))
               popupMenu->Append(wxID_HELP, wxString::Format(_("Help on \"%s\""), wordUnderCursor));
-            HelpFileAnchors::const_iterator it;
-            for (it = m_helpFileAnchors.begin(); it != m_helpFileAnchors.end(); ++it)
+            wxArrayString candidates;
+            if(helpFileAnchors)
+              helpFileAnchors->FindWithPrefix(wordUnderCursor, candidates);
+            for (auto const &cmdName : candidates)
             {
-              wxString cmdName = it->first;
-              if(cmdName.EndsWith("_"))
+              if(cmdName.EndsWith("_") || cmdName.EndsWith("pkg"))
                 continue;
-              if(cmdName.EndsWith("pkg"))
-                continue;
-              if(cmdName.StartsWith(wordUnderCursor))
-              {
-                if (wordUnderCursor != cmdName)
-                  sameBeginning.Add(cmdName);
-              }
-              else
+              if (wordUnderCursor != cmdName)
+                sameBeginning.Add(cmdName);
+            }
+            // The names from the manual and the names of the commands maxima
+            // knows of that are only a few edits away from the current word
+            std::vector<wxArrayString> similarAnchors(4);
+            std::vector<wxArrayString> similarCommands(4);
+            if(helpFileAnchors)
+              helpFileAnchors->FindSimilar(wordUnderCursor, 4, similarAnchors);
+            m_autocomplete.FindSimilarSymbols(wordUnderCursor, 4, similarCommands);
+            for(int o = 0; o<4; o++)
+            {
+              candidates = similarAnchors[o];
+              for (auto const &cmdName : similarCommands[o])
+                if(!(helpFileAnchors && helpFileAnchors->Contains(cmdName)))
+                  candidates.Add(cmdName);
+              for (auto const &cmdName : candidates)
               {
-                int dstnce = LevenshteinDistance(wordUnderCursor, cmdName);
-                if((dstnce<=4) && (dstnce > 0)) dst[dstnce-1].Add(cmdName);
+                if(cmdName.EndsWith("_") || cmdName.EndsWith("pkg"))
+                  continue;
+                if(!cmdName.StartsWith(wordUnderCursor))
+                  dst[o].Add(cmdName);
               }
             }
             m_replacementsForCurrentWord.Clear();
@@ -2084,21 +2171,34 @@ GroupCell *Worksheet::FirstVisibleGC()
 {
   wxPoint point;
   CalcUnscrolledPosition(0, 0, &point.x, &point.y);
-  wxRect rect;
-  GroupCell *tmp = GetTree();
+  return GroupCellEndingBelow(point.y + 1);
+}
 
-  while (tmp != NULL)
-  { // go through all groupcells
-    rect = tmp->GetRect();
+GroupCell *Worksheet::FirstEstimatedCellNearViewport()
+{
+  int width;
+  int height;
+  GetClientSize(&width, &height);
+  wxPoint topLeft;
+  CalcUnscrolledPosition(0, 0, &topLeft.x, &topLeft.y);
 
-    if (point.y < rect.GetBottom())
+  // The worksheet might have scrolled by less than a screen since we last laid out
+  // cells => Look for estimated cells in the same area we lay out cells in.
+  GroupCell *tmp = GroupCellEndingBelow(topLeft.y - height);
+  while((tmp != NULL) && (tmp->GetRect().GetTop() <= topLeft.y + 2 * height))
+  {
+    if(tmp->SizeIsEstimated())
       return tmp;
-
     tmp = tmp->GetNext();
   }
   return NULL;
 }
 
+GroupCell *Worksheet::GroupCellEndingBelow(int y)
+{
+  return dynamic_cast<GroupCell *>(m_cellPointers.m_groupCellIndex.FirstCellEndingBelow(GetTree(), y));
+}
+
 void Worksheet::OnMouseLeftUp(wxMouseEvent &event)
 {
   m_cellPointers.ResetSearchStart();
@@ -6156,8 +6256,20 @@ bool Worksheet::ExportToMAC(const wxString &file)
   since the last save. Then the original .wxmx file is replaced in a
   (hopefully) atomic operation.
 */
+//! Can the XML parser read xml?
+static bool XMLIsValid(const wxString &xml)
+{
+  wxXmlDocument doc;
+  wxMemoryOutputStream ostream;
+  wxTextOutputStream txtstrm(ostream);
+  txtstrm.WriteString(xml);
+  wxMemoryInputStream istream(ostream);
+  return doc.Load(istream) && doc.IsOk();
+}
+
 bool Worksheet::ExportToWXMX(const wxString &file, bool markAsSaved)
 {
+  wxLongLong saveStart = wxGetLocalTimeMillis();
   #ifdef OPENMP
   #if OPENMP_VER >= 201511
   #pragma omp taskwait
@@ -6319,116 +6431,69 @@ bool Worksheet::ExportToWXMX(const wxString &file, bool markAsSaved)
         // Reset image counter
         m_cellPointers.WXMXResetCounter();
 
-        if (GetTree())
-          xmlText += GetTree()->ListToXML();
+        // Let wxWidgets test if the document can be read again by the XML parser before
+        // the user finds out the hard way. The xml code is written to the file one
+        // GroupCell at a time, so we never need to keep the whole document in memory.
+        // Which means that each GroupCell is tested on its own.
+        bool xmlIsValid = XMLIsValid(xmlText + wxT("</wxMaximaDocument>"));
+        if (xmlIsValid && (GetTree() != NULL))
+          output << xmlText;
 
-        // Delete all but one control character from the string: there should be
-        // no way for them to enter this string, anyway. But sometimes they still
-        // do...
-        for (wxString::const_iterator it = xmlText.begin(); it != xmlText.end(); ++it)
+        // The files the cells store besides their xml code are prepared by background
+        // tasks while we write the xml code. The taskgroup waits for them.
+#ifdef HAVE_OPENMP_TASKS
+#pragma omp taskgroup
+#endif
         {
-          wxChar c = *it;
-          if ((c < wxT('\t')) ||
-              ((c > wxT('\n')) && (c < wxT(' '))) ||
-              (c == wxChar((char) 0x7F))
-            )
+          for (GroupCell *group = GetTree(); xmlIsValid && (group != NULL); group = group->GetNext())
           {
-            // *it = wxT(' ');
+            xmlText = group->ToXML();
+            if (!XMLIsValid(wxT("<wxMaximaDocument>") + xmlText + wxT("</wxMaximaDocument>")))
+              xmlIsValid = false;
+            else
+              output << xmlText;
           }
         }
 
-        xmlText +=  wxT("\n</wxMaximaDocument>");
-
+        // If we fail to load the document we abort the safe process as it will
+        // only destroy data.
+        // But we can still put the erroneous data into the clipboard for debugging purposes.
+        if (!xmlIsValid)
         {
-          // Prepare reading the files we have stored in memory
-          std::unique_ptr<wxFileSystem> fsystem(new wxFileSystem);
-          fsystem->AddHandler(new wxMemoryFSHandler);
-          fsystem->ChangePathTo(wxT("memory:"), true);
-
-          // In wxWidgets 3.1.1 fsystem->FindFirst crashes if we don't have a file
-          // in the memory filesystem => Let's create a file just to make sure
-          // one exists.
-          wxMemoryBuffer dummyBuf;
-          wxMemoryFSHandler::AddFile("dummyfile",
-                                     dummyBuf.GetData(),
-                                     dummyBuf.GetDataLen());
-
-          // Let wxWidgets test if the document can be read again by the XML parser before
-          // the user finds out the hard way.
+          if (wxTheClipboard->Open())
           {
-            wxXmlDocument doc;
-            {
-              wxMemoryOutputStream ostream;
-              wxTextOutputStream txtstrm(ostream);
-              txtstrm.WriteString(xmlText);
-              wxMemoryInputStream istream(ostream);
-              doc.Load(istream);
-            }
-
-            // If we fail to load the document we abort the safe process as it will
-            // only destroy data.
-            // But we can still put the erroneous data into the clipboard for debugging purposes.
-            if (!doc.IsOk())
-            {
-              if (wxTheClipboard->Open())
-              {
-                wxDataObjectComposite *data = new wxDataObjectComposite;
-                data->Add(new wxTextDataObject(xmlText));
-                wxTheClipboard->SetData(data);
-                wxLogMessage(_("Produced invalid XML. The erroneous XML data has therefore not been saved but has been put on the clipboard in order to allow to debug it."));
-              }
-
-              // Remove all files from our internal filesystem
-              wxString memFsName = fsystem->FindFirst("*", wxFILE);
-              while(memFsName != wxEmptyString)
-              {
-                wxString name = memFsName.Right(memFsName.Length()-7);
-                wxMemoryFSHandler::RemoveFile(name);
-                memFsName = fsystem->FindNext();
-              }
-              return false;
-            }
+            wxDataObjectComposite *data = new wxDataObjectComposite;
+            data->Add(new wxTextDataObject(xmlText));
+            wxTheClipboard->SetData(data);
+            wxLogMessage(_("Produced invalid XML. The erroneous XML data has therefore not been saved but has been put on the clipboard in order to allow to debug it."));
           }
+          m_cellPointers.WXMXGetFiles().clear();
+          return false;
+        }
 
-          // wxWidgets could pretty-print the XML document now. But as no-one will
-          // look at it, anyway, there might be no good reason to do so.
-          if (GetTree() != NULL)output << xmlText;
+        if (GetTree() != NULL)
+          output << wxT("\n</wxMaximaDocument>");
+        output.Flush();
 
-          // Move all files we have stored in memory during saving to zip file
-          wxString memFsName = fsystem->FindFirst("*", wxFILE);
-          while(memFsName != wxEmptyString)
-          {
-            wxString name = memFsName.Right(memFsName.Length()-7);
-            if(name != wxT("dummyfile"))
-            {
-              zip.CloseEntry();
+        // Move all files the cells want to be stored to the zip file
+        for (auto &file : m_cellPointers.WXMXGetFiles())
+        {
+          if (file.m_data.GetDataLen() == 0)
+            continue;
 
-              wxFSFile *fsfile;
-#ifdef HAVE_OPENMP_TASKS
-#pragma omp critical (OpenFSFile)
-#endif
-              fsfile = fsystem->OpenFile(memFsName);
+          zip.CloseEntry();
 
-              if (fsfile)
-              {
-                // The data for gnuplot is likely to change in its entirety if it
-                // ever changes => We can store it in a compressed form.
-                if(name.EndsWith(wxT(".data")))
-                  zip.SetLevel(9);
-                else
-                  zip.SetLevel(0);
-
-                zip.PutNextEntry(name);
-                std::unique_ptr<wxInputStream> imagefile(fsfile->GetStream());
-
-                while (!(imagefile->Eof()))
-                  imagefile->Read(zip);
-              }
-            }
-            wxMemoryFSHandler::RemoveFile(name);
-            memFsName = fsystem->FindNext();
-          }
+          // The data for gnuplot is likely to change in its entirety if it
+          // ever changes => We can store it in a compressed form.
+          if(file.m_name.EndsWith(wxT(".data")))
+            zip.SetLevel(9);
+          else
+            zip.SetLevel(0);
+
+          zip.PutNextEntry(file.m_name);
+          zip.Write(file.m_data.GetData(), file.m_data.GetDataLen());
         }
+        m_cellPointers.WXMXGetFiles().clear();
       }
       if(!zip.Close())
         return false;
@@ -6508,7 +6573,8 @@ bool Worksheet::ExportToWXMX(const wxString &file, bool markAsSaved)
     if (markAsSaved)
       SetSaved(true);
     
-    wxLogMessage(_("wxmx file saved"));
+    wxLogMessage(_("wxmx file saved in %li ms"),
+                 (long)(wxGetLocalTimeMillis() - saveStart).ToLong());
   }
   return true;
 }
@@ -7928,14 +7994,7 @@ bool Worksheet::FindNext(const wxString &str, bool down, bool ignoreCase, bool w
   // Default the start of the search at the top or the bottom of the screen
   wxPoint topleft;
   CalcUnscrolledPosition(0, starty, &topleft.x, &topleft.y);
-  pos = GetTree();
-  while (pos != NULL)
-  {
-    wxRect rect = pos->GetRect();
-    if (rect.GetBottom() > topleft.y)
-      break;
-    pos = pos->GetNext();
-  }
+  pos = GroupCellEndingBelow(topleft.y + 1);
 
   if (pos == NULL)
   {
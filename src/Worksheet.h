@@ -36,6 +36,7 @@
 #include <wx/fdrepdlg.h>
 #include <wx/dc.h>
 #include <list>
+#include <memory>
 
 #include "VariablesPane.h"
 #include "Notification.h"
@@ -126,7 +127,6 @@ private:
   //! A second way to publish RTF data on the clipboard
   static wxDataFormat m_rtfFormat2;
 
-  WX_DECLARE_STRING_HASH_MAP(wxString, HelpFileAnchors);
   /*! An object that can be filled with MathML data for the clipboard
    */
   class MathMLDataObject : public wxCustomDataObject
@@ -193,6 +193,15 @@ private:
   long m_lastTop;
   //! The last ending for the area being drawn
   long m_lastBottom;
+  //! The number of images BitmapCache had rendered in the background on our last check
+  unsigned long m_prefetchesDone;
+  //! When did InsertLine() add the oldest line FlushPendingOutput() hasn't handled yet?
+  wxLongLong m_outputPendingSince;
+  /*! The maximum time [in milliseconds] output may wait for being displayed
+
+    Makes the output of long-running commands still appear line by line.
+   */
+  static const long MaxOutputLatency = 200;
   /*! \defgroup UndoBufferFill Undo methods for cell additions/deletions:
 
     Each EditorCell has its own private undo buffer Additionally wxMaxima
@@ -943,9 +952,19 @@ public:
 
     If maxima isn't currently evaluating and therefore there is no working group
     the line is appended to m_last, instead.
+
+    Laying out the output and redrawing it is left to FlushPendingOutput() so
+    all lines maxima sends in one go are processed together.
   */
   void InsertLine(Cell *newCell, bool forceNewLine = false);
 
+  /*! Lays out and displays the lines InsertLine() has added since the last call
+
+    Called automatically before the worksheet is laid out or drawn and after
+    each chunk of data from maxima has been interpreted.
+   */
+  void FlushPendingOutput();
+
   // Actually recalculate the worksheet.
   bool RecalculateIfNeeded();
 
@@ -1214,6 +1233,19 @@ public:
   //! The first groupCell that is currently visible.
   GroupCell *FirstVisibleGC();
 
+  /*! The first groupCell whose bottom lies at or below the y coordinate y
+
+    Uses the index of GroupCells instead of walking through the whole worksheet.
+    Returns NULL, if all GroupCells end above y.
+  */
+  GroupCell *GroupCellEndingBelow(int y);
+
+  /*! The first cell near the visible part of the worksheet whose size is only estimated
+
+    Returns NULL, if all cells that are about to be displayed have been laid out.
+  */
+  GroupCell *FirstEstimatedCellNearViewport();
+
   /*! Scrolls to a point on the worksheet
 
     \todo I have deactivated this assert for the release as it scares the users
@@ -1518,12 +1550,28 @@ public:
   //! Returns the index in (%i...) or (%o...)
   int GetCellIndex(Cell *cell) const;
 
+  WX_DECLARE_STRING_HASH_MAP(wxString, HelpFileAnchors);
   //! All anchors for keywords maxima's helpfile contains
   HelpFileAnchors m_helpFileAnchors;
+  /*! The keywords from m_helpFileAnchors, indexed by their spelling
+
+    NULL until a background task has compiled the anchors. The index is
+    published as a whole and never changed afterwards, so it can be used
+    without a lock once GetHelpFileAnchorsIndex() has returned it.
+  */
+  std::shared_ptr<const FuzzyWordIndex> GetHelpFileAnchorsIndex() const
+  { return std::atomic_load(&m_helpFileAnchorsIndex); }
+  //! Publishes the index of the help file anchors
+  void SetHelpFileAnchorsIndex(std::shared_ptr<const FuzzyWordIndex> index)
+  { std::atomic_store(&m_helpFileAnchorsIndex, index); }
   //! Is the help file anchors available
   bool m_helpFileAnchorsUsable;
   //! Suggestions for how the word that was right-clicked on could continue
   wxArrayString m_replacementsForCurrentWord;
+private:
+  //! The index GetHelpFileAnchorsIndex() returns
+  std::shared_ptr<const FuzzyWordIndex> m_helpFileAnchorsIndex;
+public:
   //Simple iterator over a Maxima input string, skipping comments and strings
   class SimpleMathConfigurationIterator
   {
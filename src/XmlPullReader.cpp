@@ -0,0 +1,338 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class XmlPullReader that reads the xml maxima sends us
+  one node at a time.
+*/
+
+#include "XmlPullReader.h"
+#include <wx/wxcrt.h>
+#include <algorithm>
+
+XmlPullReader::XmlPullReader(const wxString &xml) :
+  m_it(xml.begin()),
+  m_end(xml.end()),
+  m_elementOpened(false),
+  m_emptyElement(false),
+  m_error(false)
+{
+}
+
+bool XmlPullReader::LookingAt(const wxString &str) const
+{
+  wxString::const_iterator it = m_it;
+  for(wxString::const_iterator ch = str.begin(); ch != str.end(); ++ch)
+  {
+    if((it == m_end) || (*it != *ch))
+      return false;
+    ++it;
+  }
+  return true;
+}
+
+void XmlPullReader::SkipWhitespace()
+{
+  while((m_it != m_end) && wxIsspace(static_cast<wxChar>(*m_it)))
+    ++m_it;
+}
+
+bool XmlPullReader::SkipUntil(const wxString &end)
+{
+  while(m_it != m_end)
+  {
+    if(LookingAt(end))
+    {
+      for(size_t i = 0; i < end.Length(); i++)
+        ++m_it;
+      return true;
+    }
+    ++m_it;
+  }
+  m_error = true;
+  return false;
+}
+
+wxString XmlPullReader::ReadName()
+{
+  wxString name;
+  while((m_it != m_end) && (!wxIsspace(static_cast<wxChar>(*m_it))) &&
+        (*m_it != wxT('/')) && (*m_it != wxT('>')) && (*m_it != wxT('<')) &&
+        (*m_it != wxT('=')) && (*m_it != wxT('"')) && (*m_it != wxT('\'')))
+  {
+    name += *m_it;
+    ++m_it;
+  }
+  return name;
+}
+
+bool XmlPullReader::ReadEntity(wxString &text)
+{
+  // Skip the '&'
+  ++m_it;
+  wxString name;
+  while((m_it != m_end) && (*m_it != wxT(';')))
+  {
+    name += *m_it;
+    ++m_it;
+    // No entity we know is that long
+    if(name.Length() > 10)
+      return false;
+  }
+  if(m_it == m_end)
+    return false;
+  // Skip the ';'
+  ++m_it;
+
+  if(name == wxT("lt"))
+    text += wxT('<');
+  else if(name == wxT("gt"))
+    text += wxT('>');
+  else if(name == wxT("amp"))
+    text += wxT('&');
+  else if(name == wxT("quot"))
+    text += wxT('"');
+  else if(name == wxT("apos"))
+    text += wxT('\'');
+  else if(name.StartsWith(wxT("#")))
+  {
+    unsigned long code;
+    bool valid;
+    if(name.StartsWith(wxT("#x")))
+      valid = name.Mid(2).ToULong(&code, 16);
+    else
+      valid = name.Mid(1).ToULong(&code, 10);
+    if((!valid) || (code == 0) || (code > 0x10FFFF))
+      return false;
+    text += wxUniChar(code);
+  }
+  else
+    return false;
+  return true;
+}
+
+wxString XmlPullReader::ReadText(wxChar terminator)
+{
+  wxString text;
+  while((m_it != m_end) && (*m_it != terminator))
+  {
+    if(*m_it == wxT('&'))
+    {
+      if(!ReadEntity(text))
+      {
+        m_error = true;
+        return text;
+      }
+    }
+    else
+    {
+      wxChar ch = *m_it;
+      if(wxIscntrl(ch))
+        text += wxT("\uFFFD");
+      else
+        text += ch;
+      ++m_it;
+    }
+  }
+  return text;
+}
+
+wxXmlNode *XmlPullReader::ReadStartTag()
+{
+  m_emptyElement = false;
+  if(m_error)
+    return NULL;
+
+  // Skip everything that might precede the first element
+  while(true)
+  {
+    SkipWhitespace();
+    if(LookingAt(wxT("<?")))
+    {
+      if(!SkipUntil(wxT("?>")))
+        return NULL;
+    }
+    else if(LookingAt(wxT("<!--")))
+    {
+      if(!SkipUntil(wxT("-->")))
+        return NULL;
+    }
+    else
+      break;
+  }
+
+  if((m_it == m_end) || (*m_it != wxT('<')))
+  {
+    m_error = true;
+    return NULL;
+  }
+  ++m_it;
+
+  wxString name = ReadName();
+  if(name.IsEmpty())
+  {
+    m_error = true;
+    return NULL;
+  }
+  wxXmlNode *node = new wxXmlNode(wxXML_ELEMENT_NODE, name);
+
+  // Read the attributes
+  while(true)
+  {
+    SkipWhitespace();
+    if(m_it == m_end)
+      break;
+    if(*m_it == wxT('>'))
+    {
+      ++m_it;
+      m_openElements.push_back(name);
+      return node;
+    }
+    if(*m_it == wxT('/'))
+    {
+      ++m_it;
+      if((m_it == m_end) || (*m_it != wxT('>')))
+        break;
+      ++m_it;
+      m_emptyElement = true;
+      return node;
+    }
+
+    wxString attributeName = ReadName();
+    if(attributeName.IsEmpty())
+      break;
+    SkipWhitespace();
+    if((m_it == m_end) || (*m_it != wxT('=')))
+      break;
+    ++m_it;
+    SkipWhitespace();
+    if((m_it == m_end) || ((*m_it != wxT('"')) && (*m_it != wxT('\''))))
+      break;
+    wxChar quote = *m_it;
+    ++m_it;
+    wxString value = ReadText(quote);
+    if((m_error) || (m_it == m_end))
+      break;
+    ++m_it;
+    node->AddAttribute(attributeName, value);
+  }
+  m_error = true;
+  wxDELETE(node);
+  return NULL;
+}
+
+wxXmlNode *XmlPullReader::ReadNode(bool stream)
+{
+  m_elementOpened = false;
+  while(!m_error)
+  {
+    // If the document ends before all elements are closed it is incomplete
+    if((m_it == m_end) || m_openElements.empty())
+    {
+      m_error = true;
+      return NULL;
+    }
+
+    if(*m_it != wxT('<'))
+    {
+      wxString text = ReadText(wxT('<'));
+      if(m_error)
+        return NULL;
+      return new wxXmlNode(wxXML_TEXT_NODE, wxT("text"), text);
+    }
+
+    if(LookingAt(wxT("</")))
+    {
+      ++m_it;
+      ++m_it;
+      wxString name = ReadName();
+      SkipWhitespace();
+      if((m_it == m_end) || (*m_it != wxT('>')) || (name != m_openElements.back()))
+      {
+        m_error = true;
+        return NULL;
+      }
+      ++m_it;
+      m_openElements.pop_back();
+      return NULL;
+    }
+
+    if(LookingAt(wxT("<![CDATA[")))
+    {
+      for(size_t i = 0; i < 9; i++)
+        ++m_it;
+      wxString text;
+      while((m_it != m_end) && (!LookingAt(wxT("]]>"))))
+      {
+        text += *m_it;
+        ++m_it;
+      }
+      if(!SkipUntil(wxT("]]>")))
+        return NULL;
+      return new wxXmlNode(wxXML_CDATA_SECTION_NODE, wxT("cdata"), text);
+    }
+
+    if(LookingAt(wxT("<!--")))
+    {
+      SkipUntil(wxT("-->"));
+      continue;
+    }
+
+    if(LookingAt(wxT("<?")))
+    {
+      SkipUntil(wxT("?>"));
+      continue;
+    }
+
+    // A new element
+    wxXmlNode *element = ReadStartTag();
+    if(element == NULL)
+      return NULL;
+    if(!m_emptyElement)
+    {
+      if(stream &&
+         (std::find(m_streamedElements.begin(), m_streamedElements.end(),
+                    element->GetName()) != m_streamedElements.end()))
+      {
+        // Leave reading the children to the next calls of ReadNode()
+        m_elementOpened = true;
+        return element;
+      }
+
+      // Read all of its children. Inserting them after the last child we have
+      // read avoids searching for the end of the list of children every time.
+      wxXmlNode *lastChild = NULL;
+      wxXmlNode *child;
+      while((child = ReadNode(false)) != NULL)
+      {
+        element->InsertChildAfter(child, lastChild);
+        lastChild = child;
+      }
+      if(m_error)
+      {
+        wxDELETE(element);
+        return NULL;
+      }
+    }
+    return element;
+  }
+  return NULL;
+}
@@ -0,0 +1,121 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file declares the class XmlPullReader that reads the xml maxima sends us
+  one node at a time.
+ */
+
+#ifndef XMLPULLREADER_H
+#define XMLPULLREADER_H
+
+#include <wx/string.h>
+#include <wx/xml/xml.h>
+#include <vector>
+
+/*! Reads a xml string one node at a time
+
+  wxXmlDocument needs the xml as a stream of bytes which means that for parsing 
+  a string it needs to be converted to UTF-8 and back and that the whole document
+  is converted to a tree of wxXmlNodes before we can start converting it to cells.
+
+  This class instead reads the xml directly from the string maxima has sent us:
+  ReadStartTag() reads the root element and every call to ReadNode() returns the
+  next child of the element that currently is open, with all of its children,
+  or, if StreamElements() lists its name, as the element that is open now.
+  This allows MathParser to convert every part of the xml to cells and to discard
+  its nodes before the next part is read.
+
+  Like our former regex-based input filter control characters that aren't escaped 
+  using a xml entity are replaced by U+FFFD.
+ */
+class XmlPullReader
+{
+public:
+  explicit XmlPullReader(const wxString &xml);
+
+  /*! Reads the start tag of the next element
+
+    \return The element without any children, or NULL if the xml doesn't contain
+    a start tag at the current position.
+    If the element isn't an empty element (that is it is not in the form
+    <code>\<tag/\></code>) every call to ReadNode() reads one of its children. 
+   */
+  wxXmlNode *ReadStartTag();
+
+  /*! Reads the next child of the current element including all of its children
+
+    \return The next child or NULL, if the closing tag of the current element has
+    been reached or if the xml was malformed: Error() tells which case it is.
+    Elements StreamElements() has been told about are returned without their
+    children, instead.
+   */
+  wxXmlNode *ReadNode() { return ReadNode(true); }
+
+  /*! Tells ReadNode() which elements not to read as a whole
+
+    ReadNode() returns these elements with their attributes, but without their
+    children, and sets ElementOpened(): The following calls to ReadNode() return
+    the children of the element, one at a time, until the element's closing tag
+    is reached. This way even the xml of an element that contains the whole
+    output maxima has sent never has to be held in memory as a tree. Inside
+    elements that are read as a whole these elements are read as a whole, too.
+   */
+  void StreamElements(const std::vector<wxString> &names) { m_streamedElements = names; }
+  //! Did the last ReadNode() return an element whose children are still to be read?
+  bool ElementOpened() const { return m_elementOpened; }
+
+  //! Did the last ReadStartTag() read an element without contents?
+  bool EmptyElement() const { return m_emptyElement; }
+  //! Did we encounter malformed xml?
+  bool Error() const { return m_error; }
+
+private:
+  //! Reads the next child. If stream is false no element is left open.
+  wxXmlNode *ReadNode(bool stream);
+  //! Skip whitespace in the markup
+  void SkipWhitespace();
+  //! Skips the rest of a comment or a processing instruction
+  bool SkipUntil(const wxString &end);
+  //! Reads the name of a tag or an attribute
+  wxString ReadName();
+  //! Reads text or an attribute value until the char terminator is encountered
+  wxString ReadText(wxChar terminator);
+  //! Reads a xml entity and appends the char it represents to text
+  bool ReadEntity(wxString &text);
+  //! Does the xml continue with str at the current position?
+  bool LookingAt(const wxString &str) const;
+
+  //! The current position in the xml string
+  wxString::const_iterator m_it;
+  //! The end of the xml string
+  wxString::const_iterator m_end;
+  //! The names of all elements whose closing tag we haven't read yet
+  std::vector<wxString> m_openElements;
+  //! The names of the elements whose children are read one by one
+  std::vector<wxString> m_streamedElements;
+  bool m_elementOpened;
+  bool m_emptyElement;
+  bool m_error;
+};
+
+#endif // XMLPULLREADER_H
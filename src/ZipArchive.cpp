@@ -0,0 +1,259 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file defines the class ZipArchive that reads the files a .wxmx file
+  contains.
+ */
+
+#include "ZipArchive.h"
+#include <wx/file.h>
+#include <wx/intl.h>
+#include <wx/log.h>
+#include <wx/mstream.h>
+#include <wx/zstream.h>
+#ifdef __WXMSW__
+#include <wx/msw/wrapwin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+//! Reads a 16-bit little-endian number
+inline size_t Read16(const unsigned char *data)
+{
+  return size_t(data[0]) | (size_t(data[1]) << 8);
+}
+
+//! Reads a 32-bit little-endian number
+inline size_t Read32(const unsigned char *data)
+{
+  return size_t(data[0]) | (size_t(data[1]) << 8) |
+    (size_t(data[2]) << 16) | (size_t(data[3]) << 24);
+}
+
+const size_t EndOfDirectorySize = 22;
+const size_t DirectoryEntrySize = 46;
+const size_t LocalHeaderSize = 30;
+}
+
+std::shared_ptr<ZipArchive> ZipArchive::Open(const wxString &filename)
+{
+  std::shared_ptr<ZipArchive> archive(new ZipArchive);
+  if (archive->Map(filename) && !archive->ReadDirectory())
+    wxLogMessage(_("Cannot read the directory of the zip archive %s"), filename);
+  return archive;
+}
+
+ZipArchive::~ZipArchive()
+{
+  if (!m_mapped)
+    return;
+  #ifdef __WXMSW__
+  UnmapViewOfFile(m_data);
+  CloseHandle(m_mapping);
+  #else
+  munmap(const_cast<unsigned char *>(m_data), m_length);
+  #endif
+}
+
+bool ZipArchive::Map(const wxString &filename)
+{
+  #ifdef __WXMSW__
+  HANDLE file = CreateFileW(filename.wc_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file != INVALID_HANDLE_VALUE)
+  {
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && (size.QuadPart > 0))
+    {
+      HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping != NULL)
+      {
+        void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data != NULL)
+        {
+          m_data = static_cast<const unsigned char *>(data);
+          m_length = size.QuadPart;
+          m_mapping = mapping;
+          m_mapped = true;
+        }
+        else
+          CloseHandle(mapping);
+      }
+    }
+    // The mapping keeps the file open
+    CloseHandle(file);
+  }
+  #else
+  int file = open(filename.fn_str(), O_RDONLY);
+  if (file >= 0)
+  {
+    struct stat info;
+    if ((fstat(file, &info) == 0) && (info.st_size > 0))
+    {
+      void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+      if (data != MAP_FAILED)
+      {
+        m_data = static_cast<const unsigned char *>(data);
+        m_length = info.st_size;
+        m_mapped = true;
+      }
+    }
+    // The mapping keeps the file open
+    close(file);
+  }
+  #endif
+  if (m_mapped)
+    return true;
+
+  // Some filesystems don't support mapping files into the memory
+  wxFile file(filename);
+  if (!file.IsOpened())
+    return false;
+  wxFileOffset length = file.Length();
+  if (length <= 0)
+    return false;
+  m_buffer.resize(length);
+  if (file.Read(m_buffer.data(), m_buffer.size()) != length)
+  {
+    m_buffer.clear();
+    return false;
+  }
+  m_data = m_buffer.data();
+  m_length = m_buffer.size();
+  return true;
+}
+
+bool ZipArchive::ReadDirectory()
+{
+  if (m_length < EndOfDirectorySize)
+    return false;
+
+  // The end of central directory record is followed by a comment of up to 64k.
+  size_t endOfDirectory = m_length - EndOfDirectorySize;
+  size_t searchLimit = (m_length > EndOfDirectorySize + 0xffff) ?
+    m_length - EndOfDirectorySize - 0xffff : 0;
+  while (Read32(m_data + endOfDirectory) != 0x06054b50)
+  {
+    if (endOfDirectory == searchLimit)
+      return false;
+    endOfDirectory--;
+  }
+
+  size_t entries = Read16(m_data + endOfDirectory + 10);
+  size_t pos = Read32(m_data + endOfDirectory + 16);
+  m_entries.reserve(entries);
+  for (size_t i = 0; i < entries; i++)
+  {
+    if ((pos + DirectoryEntrySize > m_length) || (Read32(m_data + pos) != 0x02014b50))
+      return false;
+    const unsigned char *header = m_data + pos;
+    size_t flags = Read16(header + 8);
+    size_t nameLength = Read16(header + 28);
+    size_t next = pos + DirectoryEntrySize + nameLength +
+      Read16(header + 30) + Read16(header + 32);
+    if (next > m_length)
+      return false;
+
+    Entry entry;
+    entry.m_method = Read16(header + 10);
+    entry.m_compressedSize = Read32(header + 20);
+    size_t localHeader = Read32(header + 42);
+    const char *name = reinterpret_cast<const char *>(header + DirectoryEntrySize);
+    pos = next;
+
+    // Encrypted files cannot be read anyway
+    if (flags & 1)
+      continue;
+    if ((localHeader + LocalHeaderSize > m_length) ||
+        (Read32(m_data + localHeader) != 0x04034b50))
+      continue;
+    // The local header may contain a different "extra" field than the central one
+    entry.m_offset = localHeader + LocalHeaderSize +
+      Read16(m_data + localHeader + 26) + Read16(m_data + localHeader + 28);
+    if (entry.m_offset + entry.m_compressedSize > m_length)
+      continue;
+
+    wxString entryName = wxString::FromUTF8(name, nameLength);
+    if (entryName.IsEmpty() && (nameLength > 0))
+      entryName = wxString::From8BitData(name, nameLength);
+    m_entries[entryName] = entry;
+  }
+  return true;
+}
+
+const ZipArchive::Entry *ZipArchive::FindEntry(const wxString &name) const
+{
+  wxString entryName = name;
+  if (entryName.StartsWith(wxT("/")))
+    entryName = entryName.Mid(1);
+  EntryMap::const_iterator entry = m_entries.find(entryName);
+  if (entry == m_entries.end())
+    return NULL;
+  return &entry->second;
+}
+
+bool ZipArchive::HasEntry(const wxString &name) const
+{
+  return FindEntry(name) != NULL;
+}
+
+bool ZipArchive::GetStoredEntry(const wxString &name, const void *&data, size_t &length) const
+{
+  const Entry *entry = FindEntry(name);
+  if ((entry == NULL) || (entry->m_method != 0))
+    return false;
+  data = m_data + entry->m_offset;
+  length = entry->m_compressedSize;
+  return true;
+}
+
+std::unique_ptr<wxInputStream> ZipArchive::OpenEntry(const wxString &name) const
+{
+  std::unique_ptr<wxInputStream> stream;
+  const Entry *entry = FindEntry(name);
+  if (entry == NULL)
+    return stream;
+  // A wxMemoryInputStream reads the data in place instead of copying it.
+  wxMemoryInputStream *data = new wxMemoryInputStream(m_data + entry->m_offset,
+                                                      entry->m_compressedSize);
+  switch (entry->m_method)
+  {
+  case 0:
+    stream.reset(data);
+    break;
+  case 8:
+    // The zlib stream takes ownership of the stream it reads from
+    stream.reset(new wxZlibInputStream(data, wxZLIB_NO_HEADER));
+    break;
+  default:
+    wxLogMessage(_("Cannot decompress %s from a zip archive"), name);
+    delete data;
+  }
+  return stream;
+}
@@ -0,0 +1,118 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2020 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+
+  This file declares the class ZipArchive that reads the files a .wxmx file
+  contains.
+ */
+
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <wx/string.h>
+#include <wx/stream.h>
+#include <wx/hashmap.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/*! A read-only zip archive that is mapped into memory
+
+  Reading the files in a .wxmx file using wxFileSystem and a "#zip:" URI means
+  opening the archive and searching its directory once for every file. And as
+  wxFileSystem isn't thread-safe all these accesses needed to be serialized.
+  This class maps the archive into memory once and reads its central directory
+  once. After that it only hands out streams that read from the mapped memory:
+  Files that are stored without compression (which is how wxMaxima stores its
+  images) are read without being copied, compressed files get an inflate stream
+  of their own. Which means that any number of threads can read from the archive
+  at the same time.
+
+  The archive stays mapped as long as a std::shared_ptr to it exists.
+*/
+class ZipArchive final
+{
+  ZipArchive(const ZipArchive &) = delete;
+  ZipArchive &operator=(const ZipArchive &) = delete;
+public:
+  /*! Opens a zip file
+
+    Never returns NULL: If the file cannot be read or isn't a zip file the
+    archive doesn't contain any files and IsOk() returns false.
+   */
+  static std::shared_ptr<ZipArchive> Open(const wxString &filename);
+  ~ZipArchive();
+
+  //! Could the archive be read?
+  bool IsOk() const { return m_data != NULL; }
+  //! Does the archive contain a file of this name?
+  bool HasEntry(const wxString &name) const;
+  /*! Returns a stream that reads a file from the archive
+
+    The stream may be used by any thread. NULL if the archive doesn't contain
+    the file or if it is compressed in a way we cannot decompress.
+   */
+  std::unique_ptr<wxInputStream> OpenEntry(const wxString &name) const;
+  /*! Returns the contents of a file the archive stores without compression
+
+    \retval false if the archive doesn't contain the file or if the file is
+    compressed.
+   */
+  bool GetStoredEntry(const wxString &name, const void *&data, size_t &length) const;
+
+private:
+  ZipArchive() = default;
+  //! Maps the file into the memory, or - if that fails - reads it
+  bool Map(const wxString &filename);
+  //! Reads the central directory of the archive
+  bool ReadDirectory();
+
+  //! Where a file can be found in the archive
+  struct Entry
+  {
+    //! The position of the file's data in the archive
+    size_t m_offset;
+    //! The size of the file's data in the archive
+    size_t m_compressedSize;
+    //! 0 = stored, 8 = deflated
+    int m_method;
+  };
+  typedef std::unordered_map<wxString, Entry, wxStringHash, wxStringEqual> EntryMap;
+  //! Returns the entry for name or NULL
+  const Entry *FindEntry(const wxString &name) const;
+
+  EntryMap m_entries;
+  //! The contents of the archive
+  const unsigned char *m_data = NULL;
+  //! The size of the archive
+  size_t m_length = 0;
+  //! The contents of the archive, if it couldn't be mapped into memory
+  std::vector<unsigned char> m_buffer;
+  //! Did we map the file into the memory?
+  bool m_mapped = false;
+  #ifdef __WXMSW__
+  //! The handle of the mapping (a HANDLE)
+  void *m_mapping = NULL;
+  #endif
+};
+
+#endif // ZIPARCHIVE_H
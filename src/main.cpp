@@ -35,6 +35,7 @@
 #include <wx/fileconf.h>
 #include <wx/sysopt.h>
 #include "Dirstructure.h"
+#include "BitmapCache.h"
 #include <iostream>
 
 #include "../examples/examples.h"
@@ -373,6 +374,8 @@ bool MyApp::OnInit()
 
 int MyApp::OnExit()
 {
+  // The bitmaps must not outlive the GUI toolkit.
+  BitmapCache::Get().Clear();
   return 0;
 }
 
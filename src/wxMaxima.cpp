@@ -71,6 +71,7 @@
 #include "wxMaximaIcon.h"
 #include "WXMformat.h"
 #include "ErrorRedirector.h"
+#include "CacheFile.h"
 
 #include <wx/colordlg.h>
 #include <wx/clipbrd.h>
@@ -92,12 +93,13 @@
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
 #include <wx/sckstrm.h>
-#include <wx/fs_mem.h>
 #include <wx/persist/toplevel.h>
 
 #include <wx/url.h>
 #include <wx/sstream.h>
 #include <list>
+#include <algorithm>
+#include <cstring>
 #include <memory>
 
 #if defined __WXOSX__
@@ -215,6 +217,7 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, wxLocale *locale, const wxString ti
   // everything.
   wxWindowUpdateLocker noUpdates(this);
   m_rawBytesSent = 0;
+  m_incompleteUTF8Bytes = 0;
   m_maximaBusy = true;
   m_evalOnStartup = false;
   m_dataFromMaximaIs = false;
@@ -250,8 +253,6 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, wxLocale *locale, const wxString ti
 
   m_chmhelpFile = wxEmptyString;
 
-  wxFileSystem::AddHandler(new wxMemoryFSHandler); // for saving wxmx
-
   UpdateRecentDocuments();
 
   m_worksheet->m_findDialog = NULL;
@@ -1547,6 +1548,33 @@ void wxMaxima::SendMaxima(wxString s, bool addToHistory)
 }
 
 
+size_t wxMaxima::CompleteUTF8Bytes(const char *data, size_t length)
+{
+  // A multibyte char is at most 4 bytes long => we only need to look for its
+  // start in the last 3 bytes.
+  size_t start = length;
+  while((start > 0) && (length - start < 4))
+  {
+    start--;
+    unsigned char byte = data[start];
+    // Continuation bytes look like 10xxxxxx
+    if((byte & 0xC0) == 0x80)
+      continue;
+    size_t charLength = 1;
+    if((byte & 0xE0) == 0xC0)
+      charLength = 2;
+    else if((byte & 0xF0) == 0xE0)
+      charLength = 3;
+    else if((byte & 0xF8) == 0xF0)
+      charLength = 4;
+    if(start + charLength > length)
+      return start;
+    else
+      return length;
+  }
+  return length;
+}
+
 void wxMaxima::TryToReadDataFromMaxima()
 {
   // Read out stderr: We will do that in the background on a regular basis, anyway.
@@ -1564,31 +1592,53 @@ void wxMaxima::TryToReadDataFromMaxima()
     return;
   if(!m_client->IsData())
     return;
-  if(m_clientTextStream == NULL)
-    return;
   m_statusBar->NetworkStatus(StatusBar::receive);
 
-  // Read all new lines of text we received.
-  wxChar chr;
+  if(m_socketInputData.size() < 65536)
+    m_socketInputData.resize(65536);
 
-  int newBytes = 0;
-  while((m_client->IsConnected()) && (m_client->IsData()) && (m_clientStream != NULL) &&
-        (!m_clientStream->Eof()))
+  // Read all new data we received in big blocks.
+  long newBytes = 0;
+  while((m_client->IsConnected()) && (m_client->IsData()))
   {
-    chr = m_clientTextStream->GetChar();
-    if(chr == wxEOT)
+    char *buffer = m_socketInputData.data();
+    m_client->Read(buffer + m_incompleteUTF8Bytes,
+                   m_socketInputData.size() - m_incompleteUTF8Bytes);
+    size_t bytesRead = m_client->LastReadCount();
+    if(bytesRead == 0)
       break;
-    if(chr != '\0')
-      m_newCharsFromMaxima += chr;
-    // Trigger the gui every few kilobytes so it stays responsible during
+    newBytes += bytesRead;
+    size_t bytesInBuffer = m_incompleteUTF8Bytes + bytesRead;
+
+    // Maxima sometimes sends NUL chars we don't want in our strings. As no byte
+    // of a multibyte UTF-8 char can be 0 we can drop them before decoding.
+    bytesInBuffer = std::remove(buffer, buffer + bytesInBuffer, '\0') - buffer;
+
+    // Decode everything up to the last complete char and keep the start of a
+    // char that has been split between two reads for the next round.
+    size_t completeBytes = CompleteUTF8Bytes(buffer, bytesInBuffer);
+    if(completeBytes > 0)
+    {
+      wxString newChars = wxString::FromUTF8(buffer, completeBytes);
+      if(newChars.IsEmpty())
+        newChars = wxString::From8BitData(buffer, completeBytes);
+      m_newCharsFromMaxima += newChars;
+    }
+    m_incompleteUTF8Bytes = bytesInBuffer - completeBytes;
+    if(m_incompleteUTF8Bytes > 0)
+      memmove(buffer, buffer + completeBytes, m_incompleteUTF8Bytes);
+
+    // Trigger the gui every few hundred kilobytes so it stays responsible during
     // a big data transfer
-    if(newBytes++>100000)
+    if(newBytes > 1000000)
     {
+      m_statusBar->BytesFromMaxima(newBytes);
       // Make sure that the idle loop is triggered that causes more data to be read
       CallAfter(&wxWakeUpIdle);
       return;
     }
   }
+  m_statusBar->BytesFromMaxima(newBytes);
 
   if(m_pipeToStdout)
     std::cout << m_newCharsFromMaxima;
@@ -1703,7 +1753,7 @@ void wxMaxima::OnMaximaConnect()
   {
     wxLogMessage(_("Connected."));
     m_clientStream.reset(new wxSocketInputStream(*m_client));
-    m_clientTextStream.reset(new wxTextInputStream(*m_clientStream, wxT('\t'), wxConvUTF8));
+    m_incompleteUTF8Bytes = 0;
     m_client->SetEventHandler(*GetEventHandler());
     m_client->SetNotify(wxSOCKET_INPUT_FLAG|wxSOCKET_OUTPUT_FLAG|wxSOCKET_LOST_FLAG|wxSOCKET_CONNECTION_FLAG);
     m_client->Notify(true);
@@ -2043,8 +2093,8 @@ void wxMaxima::KillMaxima(bool logMessage)
   m_maximaStdout = NULL;
   m_maximaStderr = NULL;
 
-  m_clientTextStream = NULL;
   m_clientStream = NULL;
+  m_incompleteUTF8Bytes = 0;
 
   if(m_client && (m_client->IsConnected()))
   {
@@ -2180,29 +2230,28 @@ void wxMaxima::OnProcessEvent(wxProcessEvent& event)
 ///  Dealing with stuff read from the socket
 ///--------------------------------------------------------------------------------
 
-void wxMaxima::ReadFirstPrompt(wxString &data)
+void wxMaxima::ReadFirstPrompt(const wxString &data, size_t &pos)
 {
-  int end;
-  if((end = m_currentOutput.Find(m_firstPrompt)) == wxNOT_FOUND)
+  size_t end = data.find(m_firstPrompt, pos);
+  if(end == wxString::npos)
     return;
 
   m_bytesFromMaxima = 0;
 
-  int start = 0;
-  start = data.Find(wxT("Maxima "));
-  if (start == wxNOT_FOUND)
-    start = 0;
   FirstOutput();
 
   m_maximaBusy = false;
 
   // Wait for a line maxima informs us about it's process id in.
-  int s = data.Find(wxT("pid=")) + 4;
-  int t = s + data.SubString(s, data.Length()).Find(wxT("\n")) - 1;
-
-  // Read this pid
-  if (s < t)
-    data.SubString(s, t).ToLong(&m_pid);
+  size_t s = data.find(wxT("pid="), pos);
+  if(s != wxString::npos)
+  {
+    s += 4;
+    size_t t = data.find(wxT("\n"), s);
+    // Read this pid
+    if ((t != wxString::npos) && (s < t))
+      data.Mid(s, t - s).ToLong(&m_pid);
+  }
 
   if (m_pid > 0)
     m_MenuBar->EnableItem(menu_interrupt_id, true);
@@ -2211,7 +2260,7 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
   StatusMaximaBusy(waiting);
   m_closing = false; // when restarting maxima this is temporarily true
 
-  wxString prompt_compact = data.Left(start + end + m_firstPrompt.Length() - 1);
+  wxString prompt_compact = data.Mid(pos, end + m_firstPrompt.Length() - pos);
   prompt_compact.Replace(wxT("\n"), wxT("\u21b2"));
 
 
@@ -2219,8 +2268,8 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
                                 prompt_compact.utf8_str()));
 
   wxLogMessage(wxString::Format(_("Maxima's PID is %li"),(long)m_pid));
-  // Remove the first prompt from Maxima's answer.
-  data = data.Right(data.Length() - end - m_firstPrompt.Length());
+  // Skip the first prompt in Maxima's answer.
+  pos = end + m_firstPrompt.Length();
 
   if (m_worksheet->m_evaluationQueue.Empty())
   {
@@ -2247,73 +2296,76 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
     TriggerEvaluation();
 }
 
-int wxMaxima::GetMiscTextEnd(const wxString &data)
-{
-  // These tests are redundant with later tests. But they are faster.
-  if(data.StartsWith(m_mathPrefix1) || (data.StartsWith(m_mathPrefix2)))
-    return 0;
-//  if(data.StartsWith(m_outputPromptPrefix))
-//    return 0;
-  if(data.StartsWith(m_statusbarPrefix))
-    return 0;
-  if(data.StartsWith(m_promptPrefix))
-    return 0;
-  if(data.StartsWith(m_symbolsPrefix))
-    return 0;
-  if(data.StartsWith(m_variablesPrefix))
-    return 0;
-  if(data.StartsWith(m_addVariablesPrefix))
-    return 0;
-  if(data.StartsWith(m_suppressOutputPrefix))
-    return 0;
-
-  int mthpos = wxMax(data.Find(m_mathPrefix1), data.Find(m_mathPrefix2));
-//  int lblpos = data.Find(m_outputPromptPrefix);
-  int statpos = data.Find(m_statusbarPrefix);
-  int prmptpos = data.Find(m_promptPrefix);
-  int symbolspos = data.Find(m_symbolsPrefix);
-  int suppressOutputPos = data.Find(m_suppressOutputPrefix);
-  int variablespos = data.Find(m_variablesPrefix);
-  int addvariablespos = data.Find(m_addVariablesPrefix);
-
-  int tagPos = data.Length();
-  if ((mthpos != wxNOT_FOUND) && (mthpos < tagPos))
-    tagPos = mthpos;
-//  if ((tagPos == wxNOT_FOUND) || ((lblpos != wxNOT_FOUND) && (lblpos < tagPos)))
-//    tagPos = lblpos;
-  if ((tagPos == wxNOT_FOUND) || ((statpos != wxNOT_FOUND) && (statpos < tagPos)))
-    tagPos = statpos;
-  if ((tagPos == wxNOT_FOUND) || ((prmptpos != wxNOT_FOUND) && (prmptpos < tagPos)))
-    tagPos = prmptpos;
-  if ((tagPos == wxNOT_FOUND) || ((prmptpos != wxNOT_FOUND) && (prmptpos < tagPos)))
-    tagPos = prmptpos;
-  if ((tagPos == wxNOT_FOUND) || ((symbolspos != wxNOT_FOUND) && (symbolspos < tagPos)))
-    tagPos = symbolspos;
-  if ((tagPos == wxNOT_FOUND) || ((variablespos != wxNOT_FOUND) && (variablespos < tagPos)))
-    tagPos = variablespos;
-  if ((tagPos == wxNOT_FOUND) || ((addvariablespos != wxNOT_FOUND) && (addvariablespos < tagPos)))
-    tagPos = addvariablespos;
-  if ((tagPos == wxNOT_FOUND) || ((suppressOutputPos != wxNOT_FOUND) && (suppressOutputPos < tagPos)))
-    tagPos = suppressOutputPos;
-  return tagPos;
-}
-
-void wxMaxima::ReadMiscText(wxString &data)
-{
-  if (data.IsEmpty())
+bool wxMaxima::TagAt(const wxString &data, size_t pos, const wxString &tag)
+{
+  return data.compare(pos, tag.Length(), tag) == 0;
+}
+
+wxMaxima::OutputType wxMaxima::GetOutputType(const wxString &data, size_t pos)
+{
+  if((pos + 1 >= data.Length()) || (data[pos] != wxT('<')))
+    return OUTPUT_MISCTEXT;
+
+  // The char after the '<' tells which of our tags can start here.
+  switch(static_cast<wxChar>(data[pos + 1]))
+  {
+  case wxT('m'):
+    if(TagAt(data, pos, m_mathPrefix1) || TagAt(data, pos, m_mathPrefix2))
+      return OUTPUT_MATH;
+    break;
+  case wxT('P'):
+    if(TagAt(data, pos, m_promptPrefix))
+      return OUTPUT_PROMPT;
+    break;
+  case wxT('s'):
+    if(TagAt(data, pos, m_statusbarPrefix))
+      return OUTPUT_STATUSBAR;
+    if(TagAt(data, pos, m_suppressOutputPrefix))
+      return OUTPUT_SUPPRESSED;
+    break;
+  case wxT('w'):
+    if(TagAt(data, pos, m_symbolsPrefix))
+      return OUTPUT_SYMBOLS;
+    if(TagAt(data, pos, m_addVariablesPrefix))
+      return OUTPUT_ADDVARIABLES;
+    break;
+  case wxT('v'):
+    if(TagAt(data, pos, m_variablesPrefix))
+      return OUTPUT_VARIABLES;
+    break;
+  }
+  return OUTPUT_MISCTEXT;
+}
+
+size_t wxMaxima::GetMiscTextEnd(const wxString &data, size_t pos)
+{
+  // All tags we know begin with a '<' => we only need to look for tags where we
+  // find one of these chars. This way we get along with one pass over the data.
+  size_t tagPos = pos;
+  while((tagPos = data.find(wxT('<'), tagPos)) != wxString::npos)
+  {
+    if(GetOutputType(data, tagPos) != OUTPUT_MISCTEXT)
+      return tagPos;
+    tagPos++;
+  }
+  return data.Length();
+}
+
+void wxMaxima::ReadMiscText(const wxString &data, size_t &pos)
+{
+  if (pos >= data.Length())
     return;
 
   // Extract all text that isn't a xml tag known to us.
-  int miscTextLen = GetMiscTextEnd(data);
-  if(miscTextLen <= 0)
+  size_t miscTextEnd = GetMiscTextEnd(data, pos);
+  if(miscTextEnd <= pos)
   {
-    if(data != wxEmptyString)
-      m_worksheet->m_cellPointers.m_currentTextCell = NULL;
+    m_worksheet->m_cellPointers.m_currentTextCell = NULL;
     return;
   }
 
-  wxString miscText = data.Left(miscTextLen);
-  data = data.Right(data.Length() - miscTextLen);
+  wxString miscText = data.Mid(pos, miscTextEnd - pos);
+  pos = miscTextEnd;
 
   if(miscText == "\r")
     return;
@@ -2409,30 +2461,27 @@ void wxMaxima::ReadMiscText(wxString &data)
   if(miscText.EndsWith("\n"))
     m_worksheet->m_cellPointers.m_currentTextCell = NULL;
 
-  if(data != wxEmptyString)
+  if(pos < data.Length())
     m_worksheet->m_cellPointers.m_currentTextCell = NULL;
 }
 
-int wxMaxima::FindTagEnd(const wxString &data, const wxString &tag)
+size_t wxMaxima::FindTagEnd(const wxString &data, size_t pos, const wxString &tag)
 {
   if((m_currentOutputEnd.IsEmpty()) || (m_currentOutputEnd.Find(tag) != wxNOT_FOUND))
-    return data.Find(tag);
+    return data.find(tag, pos);
   else
-    return wxNOT_FOUND;
+    return wxString::npos;
 }
 
-void wxMaxima::ReadStatusBar(wxString &data)
+void wxMaxima::ReadStatusBar(const wxString &data, size_t &pos)
 {
-  if (!data.StartsWith(m_statusbarPrefix))
-    return;
-
   m_worksheet->m_cellPointers.m_currentTextCell = NULL;
 
-  int end;
-  if ((end = FindTagEnd(data,m_statusbarSuffix)) != wxNOT_FOUND)
+  size_t end;
+  if ((end = FindTagEnd(data, pos, m_statusbarSuffix)) != wxString::npos)
   {
     wxXmlDocument xmldoc;
-    wxString xml = data.Left( end + m_statusbarSuffix.Length());
+    wxString xml = data.Mid(pos, end + m_statusbarSuffix.Length() - pos);
     wxStringInputStream xmlStream(xml);
     xmldoc.Load(xmlStream, wxT("UTF-8"));
     wxXmlNode *node = xmldoc.GetRoot();
@@ -2442,36 +2491,33 @@ void wxMaxima::ReadStatusBar(wxString &data)
       if(contents)
         LeftStatusText(contents->GetContent(), false);
     }
-    // Remove the status bar info from the data string
-    data = data.Right(data.Length()-end-m_statusbarSuffix.Length());
+    // Skip the status bar info
+    pos = end + m_statusbarSuffix.Length();
   }
 }
 
 /***
  * Checks if maxima displayed a new chunk of math
  */
-void wxMaxima::ReadMath(wxString &data)
+void wxMaxima::ReadMath(const wxString &data, size_t &pos)
 {
-  if ((!data.StartsWith(m_mathPrefix1)) && (!data.StartsWith(m_mathPrefix2)))
-    return;
-
   m_worksheet->m_cellPointers.m_currentTextCell = NULL;
 
   // Append everything from the "beginning of math" to the "end of math" marker
-  // to the console and remove it from the data we got.
-  int mthTagLen;
-  int end = FindTagEnd(data, m_mathSuffix1);
-  if(end >= 0)
+  // to the console and skip it in the data we got.
+  size_t mthTagLen;
+  size_t end = FindTagEnd(data, pos, m_mathSuffix1);
+  if(end != wxString::npos)
     mthTagLen = m_mathSuffix1.Length();
   else
   {
-    end = FindTagEnd(data, m_mathSuffix2);
+    end = FindTagEnd(data, pos, m_mathSuffix2);
     mthTagLen = m_mathSuffix2.Length();
   }
-  if(end >= 0)
+  if(end != wxString::npos)
   {
-    wxString o = data.Left(end + mthTagLen);
-    data = data.Right(data.Length() - end - mthTagLen);
+    wxString o = data.Mid(pos, end + mthTagLen - pos);
+    pos = end + mthTagLen;
     o.Trim(true);
     o.Trim(false);
     if (o.Length() > 0)
@@ -2488,49 +2534,41 @@ void wxMaxima::ReadMath(wxString &data)
   }
 }
 
-void wxMaxima::ReadSuppressedOutput(wxString &data)
+void wxMaxima::ReadSuppressedOutput(const wxString &data, size_t &pos)
 {
-  if (!data.StartsWith(m_suppressOutputPrefix))
-    return;
-  int end = FindTagEnd(data, m_suppressOutputSuffix);
-  if (end != wxNOT_FOUND)
+  size_t end = FindTagEnd(data, pos, m_suppressOutputSuffix);
+  if (end != wxString::npos)
   {
-    data = data.Right(data.Length()-end-m_suppressOutputSuffix.Length());
+    pos = end + m_suppressOutputSuffix.Length();
   }
 }
 
-void wxMaxima::ReadLoadSymbols(wxString &data)
+void wxMaxima::ReadLoadSymbols(const wxString &data, size_t &pos)
 {
-  if (!data.StartsWith(m_symbolsPrefix))
-    return;
-
   m_worksheet->m_cellPointers.m_currentTextCell = NULL;
 
-  int end = FindTagEnd(data, m_symbolsSuffix);
+  size_t end = FindTagEnd(data, pos, m_symbolsSuffix);
 
-  if (end != wxNOT_FOUND)
+  if (end != wxString::npos)
   {
     // Put the symbols into a separate string
-    wxString symbols = data.Left( end + m_symbolsSuffix.Length());
+    wxString symbols = data.Mid(pos, end + m_symbolsSuffix.Length() - pos);
     m_worksheet->AddSymbols(symbols);
 
-    // Remove the symbols from the data string
-    data = data.Right(data.Length()-end-m_symbolsSuffix.Length());
+    // Skip the symbols in the data string
+    pos = end + m_symbolsSuffix.Length();
   }
 }
 
-void wxMaxima::ReadVariables(wxString &data)
+void wxMaxima::ReadVariables(const wxString &data, size_t &pos)
 {
-  if (!data.StartsWith(m_variablesPrefix))
-    return;
-
-  int end = FindTagEnd(data, m_variablesSuffix);
+  size_t end = FindTagEnd(data, pos, m_variablesSuffix);
 
-  if (end != wxNOT_FOUND)
+  if (end != wxString::npos)
   {
     int num = 0;
     wxXmlDocument xmldoc;
-    wxString xml = data.Left( end + m_variablesSuffix.Length());
+    wxString xml = data.Mid(pos, end + m_variablesSuffix.Length() - pos);
     wxStringInputStream xmlStream(xml);
     xmldoc.Load(xmlStream, wxT("UTF-8"));
     wxXmlNode *node = xmldoc.GetRoot();
@@ -2644,25 +2682,22 @@ void wxMaxima::ReadVariables(wxString &data)
     else
       wxLogMessage(_("Maxima has sent a new variable value."));
 
-    // Remove the symbols from the data string
-    data = data.Right(data.Length()-end-m_variablesSuffix.Length());
+    // Skip the variables in the data string
+    pos = end + m_variablesSuffix.Length();
     TriggerEvaluation();
     QueryVariableValue();
   }
 }
 
-void wxMaxima::ReadAddVariables(wxString &data)
+void wxMaxima::ReadAddVariables(const wxString &data, size_t &pos)
 {
-  if (!data.StartsWith(m_addVariablesPrefix))
-    return;
-
-  int end = FindTagEnd(data, m_addVariablesSuffix);
+  size_t end = FindTagEnd(data, pos, m_addVariablesSuffix);
 
-  if (end != wxNOT_FOUND)
+  if (end != wxString::npos)
   {
     wxLogMessage(_("Maxima sends us a new set of variables for the watch list."));
     wxXmlDocument xmldoc;
-    wxString xml = data.Left( end + m_addVariablesSuffix.Length());
+    wxString xml = data.Mid(pos, end + m_addVariablesSuffix.Length() - pos);
     wxStringInputStream xmlStream(xml);
     xmldoc.Load(xmlStream, wxT("UTF-8"));
     wxXmlNode *node = xmldoc.GetRoot();
@@ -2683,7 +2718,7 @@ void wxMaxima::ReadAddVariables(wxString &data)
         var = var->GetNext();
       }
     }
-    data = data.Right(data.Length()-end-m_addVariablesSuffix.Length());
+    pos = end + m_addVariablesSuffix.Length();
   }
 }
 
@@ -2716,30 +2751,26 @@ bool wxMaxima::QueryVariableValue()
 /***
  * Checks if maxima displayed a new prompt.
  */
-void wxMaxima::ReadPrompt(wxString &data)
+void wxMaxima::ReadPrompt(const wxString &data, size_t &pos)
 {
-  m_evalOnStartup = false;
-  if (!data.StartsWith(m_promptPrefix))
-    return;
-
   m_worksheet->m_cellPointers.m_currentTextCell = NULL;
 
   // Assume we don't have a question prompt
   m_worksheet->m_questionPrompt = false;
   m_ready = true;
-  int end = FindTagEnd(data,m_promptSuffix);
+  size_t end = FindTagEnd(data, pos, m_promptSuffix);
   // Did we find a prompt?
-  if (end == wxNOT_FOUND)
+  if (end == wxString::npos)
     return;
 
   m_maximaBusy = false;
   m_bytesFromMaxima = 0;
 
-  wxString o = data.SubString(m_promptPrefix.Length(), end - 1);
-  // Remove the prompt we will process from the string.
-  data = data.Right(data.Length()-end-m_promptSuffix.Length());
-  if(data == wxT(" "))
-    data = wxEmptyString;
+  wxString o = data.Mid(pos + m_promptPrefix.Length(), end - pos - m_promptPrefix.Length());
+  // Skip the prompt we will process in the string.
+  pos = end + m_promptSuffix.Length();
+  if((pos + 1 == data.Length()) && (data[pos] == wxT(' ')))
+    pos = data.Length();
 
   // If we got a prompt our connection to maxima was successful.
   if(m_unsuccessfulConnectionAttempts > 0)
@@ -3078,42 +3109,19 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
   // open wxmx file
   wxXmlDocument xmldoc;
 
-  wxFileSystem fs;
-  
-  wxString wxmxURI = wxURI(wxT("file://") + file).BuildURI();
-  // wxURI doesn't know that a "#" in a file name is a literal "#" and
-  // not an anchor within the file so we have to care about url-encoding
-  // this char by hand.
-  wxmxURI.Replace("#", "%23");
-
-#ifdef  __WXMSW__
-  // Fixes a missing "///" after the "file:". This works because we always get absolute
-  // file names.
-  wxRegEx uriCorector1("^file:([a-zA-Z]):");
-  wxRegEx uriCorector2("^file:([a-zA-Z][a-zA-Z]):");
-
-  uriCorector1.ReplaceFirst(&wxmxURI, wxT("file:///\\1:"));
-  uriCorector2.ReplaceFirst(&wxmxURI, wxT("file:///\\1:"));
-#endif
-  // The URI of the wxm code contained within the .wxmx file
-  wxString filename = wxmxURI + wxT("#zip:content.xml");
+  std::shared_ptr<ZipArchive> wxmx = ZipArchive::Open(file);
 
   // Open the file
-  std::shared_ptr<wxFSFile> fsfile;
-  #ifdef HAVE_OPENMP_TASKS
-  #pragma omp critical (OpenFSFile)
-  #endif
-  fsfile.reset(fs.OpenFile(filename));
-  if (!fsfile)
+  std::unique_ptr<wxInputStream> content = wxmx->OpenEntry(wxT("content.xml"));
+  if (!content)
   {
     if(m_worksheet)
     {
       m_worksheet->RecalculateForce();
       m_worksheet->RecalculateIfNeeded();
     }
-    LoggingMessageBox(_("wxMaxima cannot open content.xml in the .wxmx zip archive ") + file +
-                 wxT(", URI=") + filename, _("Error"),
-                 wxOK | wxICON_EXCLAMATION);
+    LoggingMessageBox(_("wxMaxima cannot open content.xml in the .wxmx zip archive ") + file,
+                      _("Error"), wxOK | wxICON_EXCLAMATION);
     StatusMaximaBusy(waiting);
     RightStatusText(_("File could not be opened"));
     return false;
@@ -3121,23 +3129,19 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
   else
   {
     // Let's see if we can load the XML contained in this file.
-    if (!xmldoc.Load(*(fsfile->GetStream()), wxT("UTF-8"), wxXMLDOC_KEEP_WHITESPACE_NODES))
+    if (!xmldoc.Load(*content, wxT("UTF-8"), wxXMLDOC_KEEP_WHITESPACE_NODES))
     {
       // If we cannot read the file a typical error in old wxMaxima versions was to include
       // a letter of ascii code 27 in content.xml. Let's filter this char out.
       
       // Re-open the file.
-      std::shared_ptr<wxFSFile> fsfile2;
-      #ifdef HAVE_OPENMP_TASKS
-      #pragma omp critical (OpenFSFile)
-      #endif
-      fsfile2.reset(fs.OpenFile(filename));
-      if (fsfile2)
+      std::unique_ptr<wxInputStream> content2 = wxmx->OpenEntry(wxT("content.xml"));
+      if (content2)
       {
         // Read the file into a string
         wxString s;
-        wxTextInputStream istream1(*fsfile2->GetStream(), wxT('\t'), wxConvAuto(wxFONTENCODING_UTF8));
-        while (!fsfile2->GetStream()->Eof())
+        wxTextInputStream istream1(*content2, wxT('\t'), wxConvAuto(wxFONTENCODING_UTF8));
+        while (!content2->Eof())
           s += istream1.ReadLine() + wxT("\n");
         
         // Remove the illegal character
@@ -3211,7 +3215,7 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
 
   // Read the worksheet's contents.
   wxXmlNode *xmlcells = xmldoc.GetRoot();
-  GroupCell *tree = CreateTreeFromXMLNode(xmlcells, wxmxURI);
+  GroupCell *tree = CreateTreeFromXMLNode(xmlcells, wxmx);
 
   // from here on code is identical for wxm and wxmx
   if (clearDocument)
@@ -3326,7 +3330,9 @@ bool wxMaxima::OpenXML(const wxString &file, Worksheet *document)
 
   // Read the worksheet's contents.
   wxXmlNode *xmlcells = xmldoc.GetRoot();
-  GroupCell *tree = CreateTreeFromXMLNode(xmlcells, file);
+  // A plain .xml file isn't a zip archive, so there are no images or data files
+  // the cells could be loaded from.
+  GroupCell *tree = CreateTreeFromXMLNode(xmlcells);
 
   document->ClearDocument();
   StartMaxima();
@@ -3342,18 +3348,21 @@ bool wxMaxima::OpenXML(const wxString &file, Worksheet *document)
   return true;
 }
 
-GroupCell *wxMaxima::CreateTreeFromXMLNode(wxXmlNode *xmlcells, const wxString &wxmxfilename)
+GroupCell *wxMaxima::CreateTreeFromXMLNode(wxXmlNode *xmlcells, std::shared_ptr<ZipArchive> wxmxFile)
 {
   // Show a busy cursor as long as we export a .gif file (which might be a lengthy
   // action).
   wxBusyCursor crs;
 
-  MathParser mp(&m_worksheet->m_configuration, &m_worksheet->m_cellPointers, wxmxfilename);
+  MathParser mp(&m_worksheet->m_configuration, &m_worksheet->m_cellPointers, wxmxFile);
   GroupCell *tree = NULL;
   GroupCell *last = NULL;
 
   bool warning = true;
 
+  // Tokenizing the code cells can be done in parallel before we create the cells.
+  mp.TokenizeEditorTags(xmlcells);
+
   if (xmlcells)
     xmlcells = xmlcells->GetChildren();
 
@@ -3796,6 +3805,139 @@ void wxMaxima::ShowHelp(const wxString &keyword)
     ShowMaximaHelp(keyword);
 }
 
+//! The version of the format of the cache of the help file anchors
+#define HELPFILEANCHORS_CACHEVERSION 1
+
+/*! Extracts the id from a token that contains a start, the id and a closing quote
+
+  Replaces everything up to and including the closing quote by the id, as the
+  regular expression ".*<start>([a-zA-Z0-9_-]*)\"" would do.
+
+  \return false, if token doesn't contain an id.
+*/
+static bool ExtractAnchorId(wxString &token, const wxString &start)
+{
+  for(size_t pos = token.rfind(start); pos != wxString::npos;
+      pos = (pos > 0) ? token.rfind(start, pos - 1) : wxString::npos)
+  {
+    size_t idStart = pos + start.Length();
+    size_t idEnd = idStart;
+    for(wxString::const_iterator it = token.begin() + idStart; it != token.end(); ++it)
+    {
+      wxChar ch = *it;
+      if(!(((ch >= 'a') && (ch <= 'z')) || ((ch >= 'A') && (ch <= 'Z')) ||
+           ((ch >= '0') && (ch <= '9')) || (ch == '_') || (ch == '-')))
+        break;
+      idEnd++;
+    }
+    if((idEnd < token.Length()) && (token[idEnd] == '"'))
+    {
+      token = token.Mid(idStart, idEnd - idStart) + token.Mid(idEnd + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void wxMaxima::ScanHelpFileForAnchors(const wxString &helpFile, Worksheet::HelpFileAnchors &anchors)
+{
+  if(!wxFileExists(helpFile))
+    return;
+  wxFileInputStream input(helpFile);
+  if(!input.IsOk())
+    return;
+
+  const wxString idStart = wxT("<span id=\"");
+  const wxString idStart_oldManual = wxT("<a name=\"");
+  wxString escapeChars = "<=>[]`%?;\\$%&+-*/.!\'@#:^_";
+  wxTextInputStream text(input, wxT('\t'), wxConvAuto(wxFONTENCODING_UTF8));
+  while(input.IsOk() && !input.Eof())
+  {
+    wxString line = text.ReadLine();
+    // Most lines of the manual don't contain anchors
+    if((line.Find(idStart) == wxNOT_FOUND) && (line.Find(idStart_oldManual) == wxNOT_FOUND))
+      continue;
+    wxStringTokenizer tokens(line, wxT(">"));
+    while(tokens.HasMoreTokens())
+    {
+      wxString token = tokens.GetNextToken();
+      wxString id;
+      if(ExtractAnchorId(token, idStart) || ExtractAnchorId(token, idStart_oldManual))
+        id = token;
+      if(!id.IsEmpty())
+      {
+        // In anchors a space is represented by a hyphen
+        token.Replace("-", " ");
+        // Some other chars including the minus are represented by "_00xx"
+        // where xx is being the ascii code of the char.
+        if(token.Contains("_00"))
+        {
+          for(wxString::const_iterator it = escapeChars.begin(); it != escapeChars.end(); ++it)
+            token.Replace(wxString::Format("_00%x",(char)*it), *it);
+        }
+        // What the g_t means I don't know. But we don't need it
+        if(token.StartsWith("g_t"))
+          token = token.Right(token.Length()-3);
+        //! Tokens that end with "-1" aren't too useful, normally.
+        if((!token.EndsWith("-1")) && (!token.Contains(" ")))
+          anchors[token] = id;
+      }
+    }
+  }
+}
+
+bool wxMaxima::LoadHelpFileAnchorsCache(const wxString &helpFile, Worksheet::HelpFileAnchors &anchors)
+{
+  wxFileName helpFileName(helpFile);
+  if(!helpFileName.FileExists())
+    return false;
+
+  CacheFileReader cache(Dirstructure::Get()->HelpFileAnchorsCacheFile(),
+                        wxT("wxMaxima help file anchors"), HELPFILEANCHORS_CACHEVERSION);
+  if(!cache.IsOk())
+    return false;
+  wxDataInputStream &data = cache.Data();
+  // Is the cache for this version of the help file?
+  if(data.ReadString() != helpFileName.GetFullPath())
+    return false;
+  if(data.Read64() != helpFileName.GetSize().GetValue())
+    return false;
+  if((wxLongLong_t)data.Read64() != helpFileName.GetModificationTime().GetValue().GetValue())
+    return false;
+
+  Worksheet::HelpFileAnchors cachedAnchors;
+  wxUint32 count = data.Read32();
+  for(wxUint32 i = 0; (i < count) && cache.IsOk(); i++)
+  {
+    wxString keyword = data.ReadString();
+    cachedAnchors[keyword] = data.ReadString();
+  }
+  if(!cache.End())
+    return false;
+  anchors = cachedAnchors;
+  return true;
+}
+
+void wxMaxima::SaveHelpFileAnchorsCache(const wxString &helpFile, const Worksheet::HelpFileAnchors &anchors)
+{
+  wxFileName helpFileName(helpFile);
+  CacheFileWriter cache(Dirstructure::Get()->HelpFileAnchorsCacheFile(),
+                        wxT("wxMaxima help file anchors"), HELPFILEANCHORS_CACHEVERSION);
+  if(!cache.IsOk())
+    return;
+  wxDataOutputStream &data = cache.Data();
+  data.WriteString(helpFileName.GetFullPath());
+  data.Write64(helpFileName.GetSize().GetValue());
+  data.Write64(helpFileName.GetModificationTime().GetValue().GetValue());
+  data.Write32(anchors.size());
+  for(auto const &anchor : anchors)
+  {
+    data.WriteString(anchor.first);
+    data.WriteString(anchor.second);
+  }
+  cache.Commit();
+}
+
 void wxMaxima::CompileHelpFileAnchors()
 {
   wxString MaximaHelpFile = GetMaximaHelpFile();
@@ -3824,59 +3966,32 @@ void wxMaxima::CompileHelpFileAnchors()
     m_worksheet->m_helpFileAnchors["with_slider_draw3d"] = "draw3d";
     m_worksheet->m_helpFileAnchorsUsable = true;
 
-    int foundAnchors = 0;
-    wxLogMessage(_("Compiling the list of anchors the maxima manual provides"));
-    wxRegEx idExtractor(".*<span id=\\\"([a-zAZ0-9_-]*)\\\"");
-    wxRegEx idExtractor_oldManual(".*<a name=\\\"([a-zAZ0-9_-]*)\\\"");
-    wxString escapeChars = "<=>[]`%?;\\$%&+-*/.!\'@#:^_";
-    if(wxFileExists(MaximaHelpFile))
+    Worksheet::HelpFileAnchors anchors;
+    if(LoadHelpFileAnchorsCache(MaximaHelpFile, anchors))
+      wxLogMessage(_("Read the list of anchors the maxima manual provides from the cache"));
+    else
     {
-      wxFileInputStream input(MaximaHelpFile);
-      if(input.IsOk())
-      {
-        wxTextInputStream text(input, wxT('\t'), wxConvAuto(wxFONTENCODING_UTF8));
-        while(input.IsOk() && !input.Eof())
-        {
-          wxString line = text.ReadLine();
-          wxStringTokenizer tokens(line, wxT(">"));
-          while(tokens.HasMoreTokens())
-          {
-            wxString token = tokens.GetNextToken();
-            wxString oldToken(token);
-            wxString id;
-            if(idExtractor.Replace(&token, "\\1")>0)
-              id = token;
-            else
-            {
-              if(idExtractor_oldManual.Replace(&token, "\\1")>0)
-                id = token;
-            }
-            if(!id.IsEmpty())
-            {
-              // In anchors a space is represented by a hyphen
-              token.Replace("-", " ");
-              // Some other chars including the minus are represented by "_00xx"
-              // where xx is being the ascii code of the char.
-              for(wxString::const_iterator it = escapeChars.begin(); it != escapeChars.end(); ++it)
-                token.Replace(wxString::Format("_00%x",(char)*it), *it);
-              // What the g_t means I don't know. But we don't need it
-              if(token.StartsWith("g_t"))
-                token = token.Right(token.Length()-3);
-              //! Tokens that end with "-1" aren't too useful, normally.
-              if((!token.EndsWith("-1")) && (!token.Contains(" ")))
-              {
-                m_worksheet->m_helpFileAnchors[token] = id;
-                foundAnchors++;
-              }
-            }
-          }
-        }
-      }
+      wxLogMessage(_("Compiling the list of anchors the maxima manual provides"));
+      ScanHelpFileForAnchors(MaximaHelpFile, anchors);
+      if(!anchors.empty())
+        SaveHelpFileAnchorsCache(MaximaHelpFile, anchors);
     }
-    wxLogMessage(wxString::Format(_("Found %i anchors."), foundAnchors));
+    for(auto const &anchor : anchors)
+      m_worksheet->m_helpFileAnchors[anchor.first] = anchor.second;
+    wxLogMessage(wxString::Format(_("Found %i anchors."), (int)anchors.size()));
   }
   if(m_worksheet->m_helpFileAnchors["%solve"].IsEmpty())
     m_worksheet->m_helpFileAnchors["%solve"] = m_worksheet->m_helpFileAnchors["to_poly_solve"];
+  if(!m_worksheet->GetHelpFileAnchorsIndex() && !m_worksheet->m_helpFileAnchors.empty())
+  {
+    // Build the index the "did you mean" suggestions are looked up in only once.
+    // The worksheet only sees it once it is complete.
+    std::shared_ptr<FuzzyWordIndex> index = std::make_shared<FuzzyWordIndex>();
+    for(auto const &anchor : m_worksheet->m_helpFileAnchors)
+      if(!anchor.second.IsEmpty())
+        index->Add(anchor.first);
+    m_worksheet->SetHelpFileAnchorsIndex(index);
+  }
   #ifdef HAVE_OMP_HEADER
   omp_unset_lock(&m_helpFileAnchorsLock);
   #endif
@@ -3961,67 +4076,105 @@ bool wxMaxima::InterpretDataFromMaxima()
     m_dispReadOut = true;
   }
 
-  size_t length_old = 0;
+  // The position in m_currentOutput we are at: Instead of removing every bit of
+  // data we have interpreted from the start of m_currentOutput we only delete
+  // the data we are done with after we have processed all complete tags.
+  size_t pos = 0;
+  size_t pos_old = wxString::npos;
 
-  while (length_old != m_currentOutput.Length())
+  while ((pos != pos_old) && (pos < m_currentOutput.Length()))
   {
-    if (m_currentOutput.StartsWith("\n<"))
-      m_currentOutput = m_currentOutput.Right(m_currentOutput.Length() - 1);
-
-    length_old = m_currentOutput.Length();
+    if (TagAt(m_currentOutput, pos, wxT("\n<")))
+      pos++;
 
-    GroupCell *oldActiveCell = NULL;
-    GroupCell *newActiveCell = NULL;
+    pos_old = pos;
 
-    // Handle text that isn't wrapped in a known tag
     if (!m_first)
     {
-      // First read the prompt that tells us that maxima awaits the next command:
-      // If that is the case ReadPrompt() sends the next command to maxima and
-      // maxima can work while we interpret its output.
-      oldActiveCell = m_worksheet->GetWorkingGroup();
-      ReadPrompt(m_currentOutput);
-      newActiveCell = m_worksheet->GetWorkingGroup();
-
-      // Temporarily switch to the WorkingGroup the output we don't have interpreted yet
-      // was for
-      if(newActiveCell != oldActiveCell)
-        m_worksheet->m_cellPointers.SetWorkingGroup(oldActiveCell);
-      // Handle the <mth> tag that contains math output and sometimes text.
-      ReadMath(m_currentOutput);
-
-      // The following function calls each extract and remove one type of XML tag
-      // information from the beginning of the data string we got - but only do so
-      // after the closing tag has been transferred, as well.
-      ReadLoadSymbols(m_currentOutput);
-
-      // Discard startup warnings
-      ReadSuppressedOutput(m_currentOutput);
-
-      // Let's see if maxima informs us about the values of variables
-      ReadVariables(m_currentOutput);
-
-      // Let's see if maxima tells us to add new symbols to the watchlist
-      ReadAddVariables(m_currentOutput);
-
-      // Handle the XML tag that contains Status bar updates
-      ReadStatusBar(m_currentOutput);
-
-      // Handle text that isn't XML output: Mostly Error messages or warnings.
-      ReadMiscText(m_currentOutput);
+      m_evalOnStartup = false;
+      // Each of the following functions handles one type of data and skips it
+      // in m_currentOutput - but only if its closing tag has been transferred,
+      // as well.
+      OutputType type = GetOutputType(m_currentOutput, pos);
+      if(type == OUTPUT_PROMPT)
+      {
+        // The prompt tells us that maxima awaits the next command: ReadPrompt()
+        // sends the next command to maxima and maxima can work while we
+        // interpret its output.
+        GroupCell *oldActiveCell = m_worksheet->GetWorkingGroup();
+        ReadPrompt(m_currentOutput, pos);
+        GroupCell *newActiveCell = m_worksheet->GetWorkingGroup();
+
+        if(newActiveCell != oldActiveCell)
+        {
+          // Temporarily switch to the WorkingGroup the output we don't have
+          // interpreted yet was for: One piece of each kind of output that
+          // follows the prompt still belongs to it.
+          m_worksheet->m_cellPointers.SetWorkingGroup(oldActiveCell);
+          const OutputType typesAfterPrompt[] = {
+            OUTPUT_MATH, OUTPUT_SYMBOLS, OUTPUT_SUPPRESSED, OUTPUT_VARIABLES,
+            OUTPUT_ADDVARIABLES, OUTPUT_STATUSBAR, OUTPUT_MISCTEXT};
+          for(auto typeAfterPrompt : typesAfterPrompt)
+          {
+            if((pos < m_currentOutput.Length()) &&
+               (GetOutputType(m_currentOutput, pos) == typeAfterPrompt))
+              InterpretOutput(typeAfterPrompt, pos);
+          }
+          // Switch to the WorkingGroup the next bunch of data is for.
+          m_worksheet->m_cellPointers.SetWorkingGroup(newActiveCell);
+        }
+      }
+      else
+        InterpretOutput(type, pos);
     }
     else
       // This function determines the port maxima is running on from  the text
       // maxima outputs at startup. This piece of text is afterwards discarded.
-      ReadFirstPrompt(m_currentOutput);
-
-    // Switch to the WorkingGroup the next bunch of data is for.
-    if(newActiveCell != oldActiveCell)
-      m_worksheet->m_cellPointers.SetWorkingGroup(newActiveCell);
+      ReadFirstPrompt(m_currentOutput, pos);
   }
+  // Now remove everything we have interpreted in one go.
+  m_currentOutput.erase(0, pos);
+  // Lay out all lines of output we have received in one go.
+  m_worksheet->FlushPendingOutput();
   return true;
 }
 
+void wxMaxima::InterpretOutput(OutputType type, size_t &pos)
+{
+  switch(type)
+  {
+  case OUTPUT_PROMPT:
+    ReadPrompt(m_currentOutput, pos);
+    break;
+  case OUTPUT_MATH:
+    // The <mth> tag contains math output and sometimes text.
+    ReadMath(m_currentOutput, pos);
+    break;
+  case OUTPUT_SYMBOLS:
+    ReadLoadSymbols(m_currentOutput, pos);
+    break;
+  case OUTPUT_SUPPRESSED:
+    // Discard startup warnings
+    ReadSuppressedOutput(m_currentOutput, pos);
+    break;
+  case OUTPUT_VARIABLES:
+    // Maxima informs us about the values of variables
+    ReadVariables(m_currentOutput, pos);
+    break;
+  case OUTPUT_ADDVARIABLES:
+    // Maxima tells us to add new symbols to the watchlist
+    ReadAddVariables(m_currentOutput, pos);
+    break;
+  case OUTPUT_STATUSBAR:
+    ReadStatusBar(m_currentOutput, pos);
+    break;
+  case OUTPUT_MISCTEXT:
+    // Text that isn't XML output: Mostly Error messages or warnings.
+    ReadMiscText(m_currentOutput, pos);
+    break;
+  }
+}
+
 ///--------------------------------------------------------------------------------
 ///  Idle event
 ///--------------------------------------------------------------------------------
@@ -47,6 +47,7 @@
 #include <wx/sckstrm.h>
 #include <wx/buffer.h>
 #include <memory>
+#include <vector>
 #ifdef __WXMSW__
 #include <windows.h>
 #endif
@@ -275,6 +276,16 @@ private:
 
 protected:
   void CompileHelpFileAnchors();
+  /*! Reads the anchors of maxima's manual from the cache file
+
+    \return false, if the cache doesn't exist or has been created for a different
+    manual or a different version of it.
+  */
+  static bool LoadHelpFileAnchorsCache(const wxString &helpFile, Worksheet::HelpFileAnchors &anchors);
+  //! Writes the anchors of maxima's manual to the cache file
+  static void SaveHelpFileAnchorsCache(const wxString &helpFile, const Worksheet::HelpFileAnchors &anchors);
+  //! Extracts the anchors from maxima's manual
+  static void ScanHelpFileForAnchors(const wxString &helpFile, Worksheet::HelpFileAnchors &anchors);
   //! The gnuplot process info
   wxProcess *m_gnuplotProcess;
   //! Is this window active?
@@ -412,6 +423,13 @@ protected:
      as well.
   */
   void TryToReadDataFromMaxima();
+
+  /*! How many bytes at the start of a UTF-8 buffer form complete characters?
+
+    The bytes after this point are the start of a multibyte char whose remaining
+    bytes maxima hasn't sent yet.
+   */
+  static size_t CompleteUTF8Bytes(const char *data, size_t length);
     
   //! Triggered when we get new chars from maxima.
   void OnNewChars();
@@ -506,69 +524,102 @@ protected:
      - and it prepares the worksheet for editing.
 
      \param data The string ReadFirstPrompt() does read its data from. 
-                  After leaving this function data is empty again.
+     \param pos  The position in data we start reading at. After leaving this 
+                  function it points to the first char after the first prompt.
+   */
+  void ReadFirstPrompt(const wxString &data, size_t &pos);
+
+  //! The kinds of data maxima sends us, see GetOutputType()
+  enum OutputType
+  {
+    OUTPUT_MISCTEXT,     //!< Text that isn't enclosed in an xml tag known to us
+    OUTPUT_MATH,         //!< A \<mth\> or \<math\> tag
+    OUTPUT_PROMPT,       //!< A \<PROMPT\> tag
+    OUTPUT_STATUSBAR,    //!< A \<statusbar\> tag
+    OUTPUT_SYMBOLS,      //!< A \<wxxml-symbols\> tag
+    OUTPUT_VARIABLES,    //!< A \<variables\> tag
+    OUTPUT_ADDVARIABLES, //!< A \<watch_variables_add\> tag
+    OUTPUT_SUPPRESSED    //!< A \<suppressOutput\> tag
+  };
+
+  //! Does the string tag start at position pos of data?
+  static bool TagAt(const wxString &data, size_t pos, const wxString &tag);
+
+  /*! Determine which kind of data starts at the position pos of maxima's output
+
+    Only looks at the chars at pos, so this test is fast even on long outputs.
    */
-  void ReadFirstPrompt(wxString &data);
+  OutputType GetOutputType(const wxString &data, size_t pos);
+
+  //! Hands the data of the given type at position pos of m_currentOutput to its Read*() function
+  void InterpretOutput(OutputType type, size_t &pos);
 
   /*! Determine where the text for ReadMiscText ends
 
     Every error message or other line maxima outputs should end in a newline character. 
     But sometimes it doesn't and a <code>\<mth\></code> tag comes first \f$ =>\f$ This 
-    function determines where the miscellaneous text ends.
+    function determines where the miscellaneous text that starts at pos ends.
+
+    Searches for all tags known to us in a single pass over the data.
    */
-  int GetMiscTextEnd(const wxString &data);
+  size_t GetMiscTextEnd(const wxString &data, size_t pos);
+
+  /*! Find the end of a tag in wxMaxima's output.
 
-  //! Find the end of a tag in wxMaxima's output.
-  int FindTagEnd(const wxString &data, const wxString &tag);
+    \return The position of tag after pos, or wxString::npos if the tag hasn't 
+    been received yet.
+   */
+  size_t FindTagEnd(const wxString &data, size_t pos, const wxString &tag);
 
   /*! Reads text that isn't enclosed between xml tags.
 
      Some commands provide status messages before the math output or the command has finished.
      This function makes wxMaxima output them directly as they arrive.
 
-     After processing the lines not enclosed in xml tags they are removed from data.
+     After processing the lines not enclosed in xml tags pos points to the data 
+     that follows them.
    */
-  void ReadMiscText(wxString &data);
+  void ReadMiscText(const wxString &data, size_t &pos);
 
   /*! Reads the input prompt from Maxima.
 
-     After processing the input prompt it is removed from data.
+     After processing the input prompt pos points to the data that follows it.
    */
-  void ReadPrompt(wxString &data);
+  void ReadPrompt(const wxString &data, size_t &pos);
 
   /*! Reads the output of wxstatusbar() commands
 
     wxstatusbar allows the user to give and update visual feedback from long-running 
     commands and makes sure this feedback is deleted once the command is finished.
    */
-  void ReadStatusBar(wxString &data);
+  void ReadStatusBar(const wxString &data, size_t &pos);
 
   /*! Reads the math cell's contents from Maxima.
      
      Math cells are enclosed between the tags \<mth\> and \</mth\>. 
-     This function removes the from data after appending them
+     This function skips them in data after appending them
      to the console.
 
-     After processing the status bar marker is removed from data.
+     After processing the math pos points to the data that follows it.
    */
-  void ReadMath(wxString &data);
+  void ReadMath(const wxString &data, size_t &pos);
 
   /*! Reads autocompletion templates we get on definition of a function or variable
 
-    After processing the templates they are removed from data.
+    After processing the templates pos points to the data that follows them.
    */
-  void ReadLoadSymbols(wxString &data);
+  void ReadLoadSymbols(const wxString &data, size_t &pos);
 
   //! Read (and discard) suppressed output
-  void ReadSuppressedOutput(wxString &data);
+  void ReadSuppressedOutput(const wxString &data, size_t &pos);
 
   /*! Reads the variable values maxima advertises to us
    */
-  void ReadVariables(wxString &data);
+  void ReadVariables(const wxString &data, size_t &pos);
   
   /*! Reads the "add variable to watch list" tag maxima can send us
    */
-  void ReadAddVariables(wxString &data);
+  void ReadAddVariables(const wxString &data, size_t &pos);
 
 #ifndef __WXMSW__
 
@@ -644,7 +695,7 @@ protected:
   bool OpenWXMXFile(const wxString &file, Worksheet *document, bool clearDocument = true);
 
   //! Loads a wxmx description
-  GroupCell *CreateTreeFromXMLNode(wxXmlNode *xmlcells, const wxString &wxmxfilename = {});
+  GroupCell *CreateTreeFromXMLNode(wxXmlNode *xmlcells, std::shared_ptr<ZipArchive> wxmxFile = {});
 
   /*! Saves the current file
 
@@ -673,7 +724,18 @@ protected:
 
   std::unique_ptr<wxSocketBase> m_client;
   std::unique_ptr<wxSocketInputStream> m_clientStream;
-  std::unique_ptr<wxTextInputStream> m_clientTextStream;
+  /*! The buffer we read the data from maxima's socket into
+
+    Is re-used between reads so we don't need to allocate memory for every block
+    of data maxima sends.
+   */
+  std::vector<char> m_socketInputData;
+  /*! The number of bytes at the start of m_socketInputData that belong to an incomplete char
+
+    If a read from the socket ends in the middle of a multibyte UTF-8 sequence these
+    bytes are kept until the rest of the sequence arrives.
+   */
+  size_t m_incompleteUTF8Bytes;
   wxSocketServer *m_server;
   wxProcess *m_process;
   //! The stdout of the maxima process